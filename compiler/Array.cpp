@@ -0,0 +1,397 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Array.cpp
+// Multi-dimensional arrays. These are stored as one flat array in row-major
+// order, so m[i][j] in an int[R][C] is element i*C + j. That keeps a matrix in
+// one block of memory with one bounds check, instead of an array per row.
+//
+// Constant arrays are built here too; see the end of the file.
+#include <set>
+
+#include <Compiler.hpp>
+
+// Builds the size of an array being declared
+// For more than one dimension, the size of each one is kept (in a slot if it
+// isn't a constant) so indexing and sizeof can use it later.
+void Compiler::BuildArraySize(AstVarDec *vd, JavaFunction *function) {
+    std::vector<AstExpression *> sizes = vd->getExpressions();
+    if (sizes.size() <= 1) {
+        BuildExpr(vd->getPtrSize(), function);
+        return;
+    }
+
+    std::vector<ArrayDim> dims;
+    for (AstExpression *size : sizes) {
+        ArrayDim dim;
+        int64_t value = 0;
+        bool isLong = false;
+
+        if (GetLiteralValue(size, value, isLong)) {
+            dim.value = (int)value;
+        } else {
+            dim.slot = locals.AllocateTemp();
+            BuildExpr(size, function);
+            builder->CreateIStore(function, dim.slot);
+        }
+
+        dims.push_back(dim);
+    }
+
+    locals.SetDimensions(vd->getName(), dims);
+
+    BuildDimension(dims[0], function);
+    for (int i = 1; i<dims.size(); i++) BuildScale(dims[i], function);
+}
+
+// Loads the size of a dimension
+void Compiler::BuildDimension(ArrayDim dim, JavaFunction *function) {
+    if (dim.slot == -1) builder->CreateIConst(function, dim.value);
+    else builder->CreateILoad(function, dim.slot);
+}
+
+// Multiplies the value on the stack by the size of a dimension
+void Compiler::BuildScale(ArrayDim dim, JavaFunction *function) {
+    if (dim.slot == -1 && dim.value > 0 && (dim.value & (dim.value - 1)) == 0) {
+        int shift = 0;
+        while ((1 << shift) != dim.value) ++shift;
+
+        if (shift > 0) {
+            builder->CreateIConst(function, shift);
+            builder->CreateIShl(function);
+        }
+        return;
+    }
+
+    BuildDimension(dim, function);
+    builder->CreateIMul(function);
+}
+
+// Builds the flat index for an array access
+// ((i0 * d1 + i1) * d2 + i2) ... If a loop has already worked out i0 * d1 for
+// this array, we start from that.
+void Compiler::BuildArrayIndex(std::string name, std::vector<AstExpression *> indices, JavaFunction *function) {
+    LocalVar array = GetArray(name);
+    if (array.dims.empty() || indices.size() == 1) {
+        BuildExpr(indices[0], function);
+        return;
+    }
+
+    // Constant indices into constant dimensions give a constant offset
+    int64_t offset = 0;
+    bool isConst = indices.size() == array.dims.size();
+    for (int i = 0; i<indices.size() && isConst; i++) {
+        int64_t value = 0;
+        bool isLong = false;
+        isConst = GetLiteralValue(indices[i], value, isLong) && array.dims[i].slot == -1;
+        offset = offset * array.dims[i].value + value;
+    }
+
+    if (isConst) {
+        builder->CreateIConst(function, (int)offset);
+        return;
+    }
+
+    std::string key = "";
+    if (indices[0]->getType() == AstType::ID) {
+        key = name + "[" + static_cast<AstID *>(indices[0])->getValue() + "]";
+    }
+
+    if (rowOffsets.find(key) != rowOffsets.end()) {
+        builder->CreateILoad(function, rowOffsets[key]);
+    } else {
+        BuildExpr(indices[0], function);
+        BuildScale(array.dims[1], function);
+    }
+
+    for (int i = 1; i<indices.size() && i<array.dims.size(); i++) {
+        if (i > 1) BuildScale(array.dims[i], function);
+        BuildExpr(indices[i], function);
+        builder->CreateIAdd(function);
+    }
+}
+
+// Returns an array by name
+// A constant array lives in a static field instead of a slot; it comes back
+// with a slot of -1.
+LocalVar Compiler::GetArray(std::string name) {
+    if (locals.IsDefined(name) || constArrays.find(name) == constArrays.end()) {
+        return locals.GetVar(name);
+    }
+
+    LocalVar array;
+    array.slot = -1;
+    array.type = DataType::Array;
+    array.subType = constArrays[name]->getElementType();
+    return array;
+}
+
+// Loads the reference to an array
+void Compiler::BuildArrayRef(std::string name, JavaFunction *function) {
+    LocalVar array = GetArray(name);
+    if (array.slot == -1) builder->CreateGetStatic(function, name);
+    else builder->CreateALoad(function, array.slot);
+}
+
+//
+// Row offset hoisting
+//
+static void FindRowIndices(AstExpression *expr, std::vector<std::pair<std::string, std::string>> &rows);
+static void FindRowIndices(AstStatement *stmt, std::vector<std::pair<std::string, std::string>> &rows);
+
+static void AddRowIndex(std::string name, std::vector<AstExpression *> indices, std::vector<std::pair<std::string, std::string>> &rows) {
+    if (indices.size() < 2 || indices[0]->getType() != AstType::ID) return;
+    rows.push_back(std::pair<std::string, std::string>(name, static_cast<AstID *>(indices[0])->getValue()));
+}
+
+// Finds array accesses with more than one index where the first is a variable
+static void FindRowIndices(AstExpression *expr, std::vector<std::pair<std::string, std::string>> &rows) {
+    if (expr == nullptr) return;
+
+    switch (expr->getType()) {
+        case AstType::ArrayAccess: {
+            AstArrayAccess *acc = static_cast<AstArrayAccess *>(expr);
+            AddRowIndex(acc->getValue(), acc->getIndices(), rows);
+            for (AstExpression *index : acc->getIndices()) FindRowIndices(index, rows);
+        } break;
+
+        case AstType::FuncCallExpr: {
+            for (AstExpression *arg : static_cast<AstFuncCallExpr *>(expr)->getArguments()) {
+                FindRowIndices(arg, rows);
+            }
+        } break;
+
+        case AstType::Neg:
+        case AstType::Convert: FindRowIndices(static_cast<AstUnaryOp *>(expr)->getVal(), rows); break;
+
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Mul:
+        case AstType::Div:
+        case AstType::Rem:
+        case AstType::And:
+        case AstType::Or:
+        case AstType::Xor:
+        case AstType::Lsh:
+        case AstType::Rsh:
+        case AstType::EQ:
+        case AstType::NEQ:
+        case AstType::GT:
+        case AstType::LT:
+        case AstType::GTE:
+        case AstType::LTE: {
+            AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+            FindRowIndices(op->getLVal(), rows);
+            FindRowIndices(op->getRVal(), rows);
+        } break;
+
+        default: {}
+    }
+}
+
+static void FindRowIndices(AstStatement *stmt, std::vector<std::pair<std::string, std::string>> &rows) {
+    for (AstExpression *expr : stmt->getExpressions()) FindRowIndices(expr, rows);
+
+    switch (stmt->getType()) {
+        case AstType::ArrayAssign: {
+            AstArrayAssign *pa = static_cast<AstArrayAssign *>(stmt);
+            std::vector<AstExpression *> exprs = pa->getExpressions();
+            exprs.resize(pa->getIndexCount());
+            AddRowIndex(pa->getName(), exprs, rows);
+        } break;
+
+        case AstType::If: {
+            AstIfStmt *cond = static_cast<AstIfStmt *>(stmt);
+            for (AstStatement *branch : cond->getBranches()) FindRowIndices(branch, rows);
+        } break;
+
+        default: {}
+    }
+
+    switch (stmt->getType()) {
+        case AstType::If:
+        case AstType::Elif:
+        case AstType::Else:
+        case AstType::While:
+        case AstType::Repeat:
+        case AstType::For:
+        case AstType::ForAll: {
+            AstBlockStmt *blockStmt = static_cast<AstBlockStmt *>(stmt);
+            for (AstStatement *sub : blockStmt->getBlock()) FindRowIndices(sub, rows);
+        } break;
+
+        default: {}
+    }
+}
+
+// Works out row offsets that don't change inside a loop before it starts
+// For m[i][j] inside a loop that doesn't change i (or m), i*C goes in a slot
+// and each access just adds j. The loop's own index obviously changes, so it
+// never qualifies. Returns the offsets to release after the loop.
+std::vector<std::string> Compiler::HoistRowOffsets(AstStatement *loop, JavaFunction *function) {
+    std::vector<std::string> hoisted;
+
+    std::vector<std::pair<std::string, std::string>> rows;
+    std::set<std::string> assigned;
+    FindRowIndices(loop, rows);
+    FindAssigned(loop, assigned);
+
+    for (auto row : rows) {
+        std::string key = row.first + "[" + row.second + "]";
+        if (rowOffsets.find(key) != rowOffsets.end()) continue;
+        if (assigned.find(row.first) != assigned.end() || assigned.find(row.second) != assigned.end()) continue;
+        if (!locals.IsDefined(row.first) || !locals.IsDefined(row.second)) continue;
+
+        LocalVar array = locals.GetVar(row.first);
+        LocalVar index = locals.GetVar(row.second);
+        if (array.dims.size() < 2 || !IsIntType(index.type)) continue;
+
+        int slot = locals.AllocateTemp();
+        builder->CreateILoad(function, index.slot);
+        BuildScale(array.dims[1], function);
+        builder->CreateIStore(function, slot);
+
+        rowOffsets[key] = slot;
+        hoisted.push_back(key);
+    }
+
+    return hoisted;
+}
+
+// Releases the row offsets hoisted for a loop
+void Compiler::ReleaseRowOffsets(std::vector<std::string> hoisted) {
+    for (std::string key : hoisted) {
+        locals.ReleaseTemp(rowOffsets[key]);
+        rowOffsets.erase(key);
+    }
+}
+
+//
+// Constant arrays
+//
+// Each one is a private static final field, filled in by <clinit>. Storing the
+// elements one at a time costs about 7 bytes of bytecode each, so a big table
+// would soon run into the 64KB limit on a method (and be slow to load).
+// Instead, the elements are packed into a string constant and unpacked with a
+// short loop.
+
+// Below this many elements, storing each one takes less code than unpacking
+static const int packMinimum = 8;
+
+// Builds the field for a constant array and the code that fills it in
+void Compiler::BuildConstArray(AstConstArray *array, JavaFunction *init) {
+    std::string name = array->getName();
+    DataType type = array->getElementType();
+    std::vector<int64_t> values = array->getValues();
+
+    builder->CreateField(name, GetDescriptor(DataType::Array, type), F_PRIVATE | F_STATIC | F_FINAL);
+
+    if (values.size() >= packMinimum) {
+        BuildPackedArray(array, init);
+        builder->CreatePutStatic(init, name);
+        return;
+    }
+
+    // New arrays are already zero
+    builder->CreateIConst(init, values.size());
+    builder->CreateNewArray(init, GetArrayType(type));
+    for (int i = 0; i<values.size(); i++) {
+        if (values[i] == 0) continue;
+
+        builder->CreateDup(init);
+        builder->CreateIConst(init, i);
+        if (type == DataType::Int64 || type == DataType::UInt64) builder->CreateLConst(init, values[i]);
+        else builder->CreateIConst(init, (int)values[i]);
+        BuildArrayStore(type, init);
+    }
+    builder->CreatePutStatic(init, name);
+}
+
+// Unpacks a constant array from a string, leaving it on the stack
+// Each element takes as many 16-bit chars as it needs, high half first:
+//   byte[]:        one char per byte, read with getBytes(ISO_8859_1)
+//   char[]:        the chars themselves, read with toCharArray()
+//   bool/short[]:  one char per element
+//   int[]:         two chars per element
+//   long[]:        four chars per element
+// The last three are read by a loop over the string's chars:
+//   chars = str.toCharArray(); a = new T[n];
+//   for (i = 0, j = 0; i < a.length; i++) a[i] = (chars[j++] << 16) | chars[j++] ...
+void Compiler::BuildPackedArray(AstConstArray *array, JavaFunction *init) {
+    DataType type = array->getElementType();
+    std::string descriptor = GetDescriptor(type);
+    std::vector<int64_t> values = array->getValues();
+
+    int width = 1;
+    if (descriptor == "I") width = 2;
+    else if (descriptor == "J") width = 4;
+
+    std::vector<uint16_t> chars;
+    for (int64_t value : values) {
+        if (descriptor == "B") value &= 0xFF;
+        for (int i = width - 1; i >= 0; i--) chars.push_back((uint16_t)(value >> (i * 16)));
+    }
+    builder->CreatePackedString(init, chars);
+
+    if (descriptor == "B") {
+        if (!builder->HasField("ISO_8859_1")) {
+            builder->ImportField("java/nio/charset/StandardCharsets", "java/nio/charset/Charset", "ISO_8859_1");
+        }
+        BuildLibraryMethod("java/lang/String", "getBytes", "(Ljava/nio/charset/Charset;)[B");
+
+        builder->CreateGetStatic(init, "ISO_8859_1");
+        builder->CreateInvokeVirtual(init, "getBytes", "java/lang/String", "(Ljava/nio/charset/Charset;)[B");
+        return;
+    }
+
+    BuildLibraryMethod("java/lang/String", "toCharArray", "()[C");
+    builder->CreateInvokeVirtual(init, "toCharArray", "java/lang/String", "()[C");
+    if (descriptor == "C") return;
+
+    // Slot 0 holds the chars, 1 the array, 2 its index and 3 the index into the chars
+    if (init->getMaxLocals() < 4) init->setMaxLocals(4);
+
+    builder->CreateAStore(init, 0);
+    builder->CreateIConst(init, values.size());
+    builder->CreateNewArray(init, GetArrayType(type));
+    builder->CreateAStore(init, 1);
+    builder->CreateIConst(init, 0);
+    builder->CreateIStore(init, 2);
+    builder->CreateIConst(init, 0);
+    builder->CreateIStore(init, 3);
+
+    int bodyLabel = builder->CreateLabel(init);
+    int condLabel = builder->CreateLabel(init);
+    builder->CreateGoto(init, condLabel);
+
+    builder->SetLabel(init, bodyLabel);
+    builder->CreateALoad(init, 1);
+    builder->CreateILoad(init, 2);
+
+    for (int i = 0; i<width; i++) {
+        if (i > 0) builder->CreateIConst(init, 16);
+        if (i > 0 && width == 4) builder->CreateLShl(init);
+        else if (i > 0) builder->CreateIShl(init);
+
+        builder->CreateALoad(init, 0);
+        builder->CreateILoad(init, 3);
+        builder->CreateIInc(init, 3, 1);
+        builder->CreateCALoad(init);
+
+        if (width == 4) builder->CreateI2L(init);
+        if (i > 0 && width == 4) builder->CreateLOr(init);
+        else if (i > 0) builder->CreateIOr(init);
+    }
+
+    BuildArrayStore(type, init);
+    builder->CreateIInc(init, 2, 1);
+
+    builder->SetLabel(init, condLabel);
+    builder->CreateILoad(init, 2);
+    builder->CreateALoad(init, 1);
+    builder->CreateArrayLength(init);
+    builder->CreateBranch(init, B_IF_ICMPLT, bodyLabel);
+    builder->CreateALoad(init, 1);
+}
@@ -8,13 +8,24 @@
 
 #include <Compiler.hpp>
 
-Compiler::Compiler(std::string className) {
+Compiler::Compiler(std::string className, CompilerOptions options) {
     this->className = className;
+    this->options = options;
     builder = new JavaClassBuilder(className);
+    builder->SetVersion(options.target);
+    
+    // With buffered output, println goes to our own stream instead of System.out
+    if (options.bufferedStdout) {
+        builder->CreateField("stdout", "Ljava/io/PrintStream;", F_PRIVATE | F_STATIC);
+    } else {
+        builder->ImportField("java/lang/System", "java/io/PrintStream", "out");
+    }
     
-    builder->ImportField("java/lang/System", "java/io/PrintStream", "out");
     builder->ImportMethod("java/io/PrintStream", "println", "(Ljava/lang/String;)V");
     builder->ImportMethod("java/io/PrintStream", "println", "(I)V");
+    builder->ImportMethod("java/io/PrintStream", "println", "(Z)V");
+    builder->ImportMethod("java/io/PrintStream", "println", "(C)V");
+    builder->ImportMethod("java/io/PrintStream", "println", "(J)V");
 }
 
 void Compiler::Build(AstTree *tree) {
@@ -25,41 +36,176 @@ void Compiler::Build(AstTree *tree) {
     builder->CreateALoad(construct, 0);
     builder->CreateInvokeSpecial(construct, "<init>", "java/lang/Object");
     builder->CreateRetVoid(construct);
+    construct->setMaxLocals(1);
+    
+    // Fold constants before we generate anything
+    if (options.fold) folder.Run(tree);
 
-    // Build the functions (declarations only)
+    // Find everything declared in the class first, since how a method is
+    // declared depends on the methods it calls
     for (auto GS : tree->getGlobalStatements()) {
         if (GS->getType() == AstType::Func) {
-            BuildFunction(GS);
+            AstFunction *func = static_cast<AstFunction *>(GS);
+            funcAsts[func->getName()] = func;
+        } else if (GS->getType() == AstType::Struct) {
+            AstStruct *str = static_cast<AstStruct *>(GS);
+            structs[str->getName()] = str;
+        } else if (GS->getType() == AstType::ConstArray) {
+            AstConstArray *array = static_cast<AstConstArray *>(GS);
+            constArrays[array->getName()] = array;
         }
     }
     
+    if (options.bufferedStdout || !constArrays.empty()) BuildStaticInit();
+    FindStaticMethods();
+    
+    // Build the functions (declarations only)
+    for (auto GS : tree->getGlobalStatements()) {
+        if (GS->getType() == AstType::Func) BuildFunction(GS);
+    }
+    
     // Now the code
     for (auto GS : tree->getGlobalStatements()) {
         if (GS->getType() == AstType::Func) {
             AstFunction *funcAst = static_cast<AstFunction *>(GS);
             JavaFunction *func = funcMap[funcAst->getName()];
+            int reported = tailCallReport.size();
             
-            for (AstStatement *stmt : funcAst->getBlock()->getBlock()) {
-                BuildStatement(stmt, func);
+            BuildFunctionBody(funcAst, func);
+            if (options.splitting && func->getCodeBlock()->getCodeSize() > options.hugeMethodLimit) {
+                SplitFunction(funcAst, func, reported);
             }
         }
     }
+    
+    // Inlining shouldn't undo the splitting
+    int maxSize = options.splitting ? options.hugeMethodLimit : 65535;
+    if (options.inlining) builder->RunInliner(options.inlineThreshold, maxSize);
+    if (options.peephole) builder->RunPeephole();
 }
 
-void Compiler::Write() {
+bool Compiler::Write() {
     std::string fullName = className + ".class";
     
     FILE *file = fopen(fullName.c_str(), "wb");
-    builder->Write(file);
+    bool ok = builder->Write(file);
     fclose(file);
+    
+    // Don't leave a half-written class behind
+    if (!ok) remove(fullName.c_str());
+    return ok;
+}
+
+// Prints what the optimizations did
+void Compiler::PrintStats() {
+    std::cout << "Stats for " << className << ".class:" << std::endl;
+    
+    if (options.fold) {
+        std::cout << "  fold:" << std::endl;
+        for (auto hit : folder.GetStats()) {
+            std::cout << "    " << hit.first << ": " << hit.second << std::endl;
+        }
+    } else {
+        std::cout << "  fold: disabled" << std::endl;
+    }
+    
+    if (options.peephole) {
+        std::cout << "  peephole: " << builder->GetPeepholeSaved() << " bytes saved" << std::endl;
+        for (auto hit : builder->GetPeepholeHits()) {
+            std::cout << "    " << hit.first << ": " << hit.second << std::endl;
+        }
+    } else {
+        std::cout << "  peephole: disabled" << std::endl;
+    }
+}
+
+// Prints every call to one of our own methods, and whether it was inlined
+void Compiler::PrintInlineReport() {
+    std::cout << "Inlining in " << className << ".class:" << std::endl;
+    
+    if (!options.inlining) {
+        std::cout << "  disabled" << std::endl;
+        return;
+    }
+    
+    for (std::string line : builder->GetInlineReport()) {
+        std::cout << "  " << line << std::endl;
+    }
+}
+
+// Prints every self call that was turned into a loop
+void Compiler::PrintTailCallReport() {
+    std::cout << "Tail calls in " << className << ".class:" << std::endl;
+    
+    for (std::string line : tailCallReport) {
+        std::cout << "  " << line << std::endl;
+    }
+}
+
+// Prints every method that was split, and into how many helpers
+void Compiler::PrintSplitReport() {
+    std::cout << "Split methods in " << className << ".class:" << std::endl;
+    
+    if (!options.splitting) {
+        std::cout << "  disabled" << std::endl;
+        return;
+    }
+    
+    for (std::string line : splitReport) {
+        std::cout << "  " << line << std::endl;
+    }
+}
+
+// Builds the static initializer
+// This opens the buffered output stream and fills in the constant arrays.
+void Compiler::BuildStaticInit() {
+    JavaFunction *init = builder->CreateMethod("<clinit>", "()V", F_STATIC);
+    init->setMaxLocals(0);
+    
+    if (options.bufferedStdout) BuildStdoutInit(init);
+    for (auto entry : constArrays) BuildConstArray(entry.second, init);
+    
+    builder->CreateRetVoid(init);
+}
+
+// Opens the buffered output stream
+// This is the same file descriptor System.out writes to, but with a 64KB buffer
+// and no flush after every line:
+//   stdout = new PrintStream(new BufferedOutputStream(new FileOutputStream(FileDescriptor.out), 65536), false);
+void Compiler::BuildStdoutInit(JavaFunction *init) {
+    BuildLibraryMethod("java/io/PrintStream", "<init>", "(Ljava/io/OutputStream;Z)V");
+    BuildLibraryMethod("java/io/BufferedOutputStream", "<init>", "(Ljava/io/OutputStream;I)V");
+    BuildLibraryMethod("java/io/FileOutputStream", "<init>", "(Ljava/io/FileDescriptor;)V");
+    builder->ImportField("java/io/FileDescriptor", "java/io/FileDescriptor", "out");
+    
+    builder->CreateNew(init, "java/io/PrintStream");
+    builder->CreateDup(init);
+    builder->CreateNew(init, "java/io/BufferedOutputStream");
+    builder->CreateDup(init);
+    builder->CreateNew(init, "java/io/FileOutputStream");
+    builder->CreateDup(init);
+    builder->CreateGetStatic(init, "out");
+    builder->CreateInvokeSpecial(init, "<init>", "java/io/FileOutputStream", "(Ljava/io/FileDescriptor;)V");
+    builder->CreateIConst(init, 65536);
+    builder->CreateInvokeSpecial(init, "<init>", "java/io/BufferedOutputStream", "(Ljava/io/OutputStream;I)V");
+    builder->CreateIConst(init, 0);
+    builder->CreateInvokeSpecial(init, "<init>", "java/io/PrintStream", "(Ljava/io/OutputStream;Z)V");
+    builder->CreatePutStatic(init, "stdout");
+}
+
+// Loads the stream println writes to
+void Compiler::BuildStdout(JavaFunction *function) {
+    builder->CreateGetStatic(function, options.bufferedStdout ? "stdout" : "out");
 }
 
 // Builds a function
 void Compiler::BuildFunction(AstGlobalStatement *GS) {
     AstFunction *func = static_cast<AstFunction *>(GS);
     
-    int flags = 0;
-    if (func->isRoutine()) flags |= F_STATIC;
+    // Nothing can override our methods
+    int flags = F_FINAL;
+    if (IsStaticMethod(func->getName())) flags |= F_STATIC;
+    if (splitHelpers.find(func->getName()) != splitHelpers.end()) flags |= F_SYNTHETIC;
     
     switch (func->getAttribute()) {
         case Attr::Public: flags |= F_PUBLIC; break;
@@ -67,35 +213,116 @@ void Compiler::BuildFunction(AstGlobalStatement *GS) {
         case Attr::Private: flags |= F_PRIVATE; break;
     }
     
-    std::string signature = "()V";
-    if (func->getName() == "main") signature = "([Ljava/lang/String;)V";
-    
-    JavaFunction *function = builder->CreateMethod(func->getName(), signature, flags);
+    JavaFunction *function = builder->CreateMethod(func->getName(), GetSignature(func), flags);
     funcMap[func->getName()] = function;
+    funcAsts[func->getName()] = func;
     
     /*for (AstStatement *stmt : func->getBlock()->getBlock()) {
         BuildStatement(stmt, function);
     }*/
 }
 
+// Builds the code for a function
+void Compiler::BuildFunctionBody(AstFunction *funcAst, JavaFunction *function) {
+    // Slot 0 is "this" for anything that isn't static
+    locals.Reset(IsStaticMethod(funcAst->getName()) ? 0 : 1);
+    currentFunc = funcAst;
+    
+    // Parameters arrive in the slots after that, in order
+    for (Var arg : funcAst->getArguments()) {
+        std::string className = "";
+        if (arg.type == DataType::String) className = "java/lang/String";
+        locals.BindParameter(arg.name, arg.type, arg.subType, className);
+    }
+    
+    tailCalls.clear();
+    FindTailCalls(funcAst->getBlock()->getBlock());
+    if (!tailCalls.empty()) {
+        tailEntry = builder->CreateLabel(function);
+        builder->SetLabel(function, tailEntry);
+    }
+    
+    BuildBlock(funcAst->getBlock(), function);
+    
+    function->setMaxLocals(locals.GetMaxLocals());
+}
+
+// Builds a block of statements
+// Locals declared in the block are released after their last use so later
+// declarations can reuse the slot
+void Compiler::BuildBlock(AstBlock *block, JavaFunction *function) {
+    locals.EnterScope();
+    
+    std::map<std::string, int> lastUses = FindLastUses(block);
+    std::vector<AstStatement *> stmts = block->getBlock();
+    
+    for (int i = 0; i<stmts.size(); i++) {
+        BuildStatement(stmts[i], function);
+        
+        for (auto use : lastUses) {
+            if (use.second == i && locals.InCurrentScope(use.first)) {
+                locals.Release(use.first);
+            }
+        }
+    }
+    
+    locals.ExitScope();
+}
+
 // Builds a statement
 void Compiler::BuildStatement(AstStatement *stmt, JavaFunction *function) {
+    int start = function->getCodeBlock()->code.size();
+    
     switch (stmt->getType()) {
         case AstType::VarDec: BuildVarDec(stmt, function); break;
         case AstType::VarAssign: BuildVarAssign(stmt, function); break;
+        case AstType::ArrayAssign: BuildArrayAssign(stmt, function); break;
+        case AstType::StructDec: BuildStructDec(stmt, function); break;
+        case AstType::StructAssign: BuildStructAssign(stmt, function); break;
     
-        case AstType::FuncCallStmt: BuildFuncCallStatement(stmt, function); break;
-    
-        case AstType::Return: {
-            if (stmt->getExpressionCount() == 0) {
-                builder->CreateRetVoid(function);
+        case AstType::FuncCallStmt: {
+            if (tailCalls.find(stmt) != tailCalls.end()) {
+                BuildTailCall(stmt, stmt->getExpressions(), function);
             } else {
-                // TODO
+                BuildFuncCallStatement(stmt, function);
             }
         } break;
         
+        case AstType::If: BuildIf(stmt, function); break;
+        case AstType::While: BuildWhile(stmt, function); break;
+        case AstType::Repeat: BuildRepeat(stmt, function); break;
+        case AstType::For: BuildFor(stmt, function); break;
+        case AstType::ForAll: BuildForAll(stmt, function); break;
+        
+        case AstType::Break:
+        case AstType::Continue: BuildLoopCtrl(stmt, function); break;
+    
+        case AstType::Return: BuildReturn(stmt, function); break;
+        
         default: {}
     }
+    
+    codeRanges[stmt] = std::make_pair(start, (int)function->getCodeBlock()->code.size());
+}
+
+// Returns the narrowest newarray type that holds an element type
+// Unsigned shorts go in a char array, since chars are the JVM's unsigned 16-bit
+// type. Unsigned bytes have to be masked on load.
+JavaArrayType GetArrayType(DataType type) {
+    switch (type) {
+        case DataType::Bool: return T_BOOLEAN;
+        case DataType::Byte:
+        case DataType::UByte: return T_BYTE;
+        case DataType::Char:
+        case DataType::UShort: return T_CHAR;
+        case DataType::Short: return T_SHORT;
+        case DataType::Int64:
+        case DataType::UInt64: return T_LONG;
+        
+        default: {}
+    }
+    
+    return T_INT;
 }
 
 // Builds a variable declaration
@@ -103,24 +330,34 @@ void Compiler::BuildVarDec(AstStatement *stmt, JavaFunction *function) {
     AstVarDec *vd = static_cast<AstVarDec *>(stmt);
     
     switch (vd->getDataType()) {
-        case DataType::Int32: {
-            intMap[vd->getName()] = iCount;
-            ++iCount;
+        // The parser follows this with a malloc call; the array is created here instead
+        case DataType::Array: {
+            int pos = locals.Allocate(vd->getName(), DataType::Array, vd->getPtrType());
+            
+            BuildArraySize(vd, function);
+            if (vd->getPtrType() == DataType::String) {
+                builder->CreateANewArray(function, "java/lang/String");
+            } else {
+                builder->CreateNewArray(function, GetArrayType(vd->getPtrType()));
+            }
+            builder->CreateAStore(function, pos);
         } break;
     
         case DataType::Object: {
-            objMap[vd->getName()] = aCount;
-            ++aCount;
-            
-            objTypeMap[vd->getName()] = vd->getClassName();
+            int pos = locals.Allocate(vd->getName(), DataType::Object, DataType::Void, vd->getClassName());
             
             builder->CreateNew(function, vd->getClassName());
             builder->CreateDup(function);
             builder->CreateInvokeSpecial(function, "<init>", vd->getClassName());
-            builder->CreateAStore(function, aCount - 1);
+            builder->CreateAStore(function, pos);
         } break;
         
-        default: {}
+        // Everything else is a scalar; longs take two slots
+        default: {
+            std::string className = vd->getClassName();
+            if (vd->getDataType() == DataType::String) className = "java/lang/String";
+            locals.Allocate(vd->getName(), vd->getDataType(), DataType::Void, className);
+        }
     }
 }
 
@@ -128,55 +365,171 @@ void Compiler::BuildVarDec(AstStatement *stmt, JavaFunction *function) {
 void Compiler::BuildVarAssign(AstStatement *stmt, JavaFunction *function) {
     AstVarAssign *va = static_cast<AstVarAssign *>(stmt);
     
-    BuildExpr(va->getExpression(), function, va->getDataType());
+    if (va->getDataType() == DataType::Array && va->getExpression()->getType() == AstType::FuncCallExpr) {
+        AstFuncCallExpr *fc = static_cast<AstFuncCallExpr *>(va->getExpression());
+        if (fc->getName() == "malloc") return;
+    }
     
-    switch (va->getDataType()) {
-        case DataType::Int32: {
-            int iPos = intMap[va->getName()];
-            builder->CreateIStore(function, iPos);
-        } break;
-        
-        default: {}
+    if (va->getDataType() == DataType::Struct) {
+        BuildStructCopy(va, function);
+        return;
     }
+    
+    // Narrowing to a sub-word type was put in by the type checker
+    BuildExpr(va->getExpression(), function);
+    BuildLocalStore(locals.GetVar(va->getName()), function);
+}
+
+// Builds an array element assignment
+// The store instructions truncate to the element width themselves, so values
+// don't need an explicit i2b/i2c/i2s first.
+void Compiler::BuildArrayAssign(AstStatement *stmt, JavaFunction *function) {
+    AstArrayAssign *pa = static_cast<AstArrayAssign *>(stmt);
+    std::vector<AstExpression *> exprs = pa->getExpressions();
+    DataType type = pa->getPtrType();
+    
+    AstExpression *rval = exprs.back();
+    exprs.resize(pa->getIndexCount());
+    
+    builder->CreateALoad(function, locals.GetSlot(pa->getName()));
+    BuildArrayIndex(pa->getName(), exprs, function);
+    
+    BuildExpr(rval, function);
+    BuildArrayStore(type, function);
 }
 
 // Builds a function call statement
+// Whatever a call returns is thrown away here
 void Compiler::BuildFuncCallStatement(AstStatement *stmt, JavaFunction *function) {
     AstFuncCallStmt *fc = static_cast<AstFuncCallStmt *>(stmt);
     
     if (fc->getName() == "println") {
-        builder->CreateGetStatic(function, "out");
+        BuildStdout(function);
     }
     
-    std::string signature = "";
+    DataType type = BuildCall(fc->getName(), fc->getObjectName(), fc->getExpressions(), function);
+    if (type != DataType::Void) builder->CreatePop(function, SlotAllocator::GetWidth(type));
+}
+
+// Builds a call and returns the type it leaves on the stack
+// Our own methods use the descriptor of their declaration, so each argument is
+// built as the type of its parameter. Anything else is taken to be a void method
+// with a descriptor made from the arguments.
+DataType Compiler::BuildCall(std::string name, std::string objectName, std::vector<AstExpression *> args, JavaFunction *function) {
     std::string baseClass = "";
     
-    if (fc->getObjectName() == "this") {
+    if (objectName == "this") {
         baseClass = "this";
-        builder->CreateALoad(function, 0);
-    } else if (fc->getObjectName() != "") {
-        baseClass = objTypeMap[fc->getObjectName()];
+    } else if (objectName != "") {
+        baseClass = locals.GetVar(objectName).className;
         //if (baseClass == className) baseClass = "";
+    }
+    
+    bool local = (baseClass == "" || baseClass == "this" || baseClass == className);
+    if (local && funcAsts.find(name) != funcAsts.end()) {
+        AstFunction *callee = funcAsts[name];
+        std::vector<Var> params = callee->getArguments();
+        
+        bool isStatic = IsStaticMethod(name);
+        bool onThis = objectName == "" || objectName == "this";
+        
+        if (!isStatic) {
+            int pos = onThis ? 0 : locals.GetSlot(objectName);
+            builder->CreateALoad(function, pos);
+        }
+        
+        for (AstExpression *arg : args) BuildExpr(arg, function);
+        
+        // There's only one method a call here can reach, so bind it directly
+        if (isStatic) builder->CreateInvokeStatic(function, name, "this", GetSignature(callee));
+        else if (onThis || callee->getAttribute() == Attr::Private) builder->CreateInvokeSpecial(function, name, "this", GetSignature(callee));
+        else builder->CreateInvokeVirtual(function, name, "this", GetSignature(callee));
         
-        int pos = objMap[fc->getObjectName()];
-        builder->CreateALoad(function, pos);
+        return callee->getDataType();
     }
     
-    for (AstExpression *expr : fc->getExpressions()) {
-        signature = GetTypeForExpr(expr);
-        BuildExpr(expr, function);
+    if (objectName == "this") {
+        builder->CreateALoad(function, 0);
+    } else if (objectName != "") {
+        builder->CreateALoad(function, locals.GetSlot(objectName));
+    }
+    
+    std::string signature = "";
+    for (AstExpression *expr : args) {
+        if (name == "println") {
+            signature += BuildStringValue(expr, function);
+        } else {
+            BuildExpr(expr, function);
+            signature += GetTypeForExpr(expr);
+        }
     }
     
     signature = "(" + signature + ")V";
-    builder->CreateInvokeVirtual(function, fc->getName(), baseClass, signature);
+    builder->CreateInvokeVirtual(function, name, baseClass, signature);
+    
+    return DataType::Void;
+}
+
+// Builds a return statement
+// The value is built as the function's type, so the right *return goes with it
+void Compiler::BuildReturn(AstStatement *stmt, JavaFunction *function) {
+    if (tailCalls.find(stmt) != tailCalls.end()) {
+        AstFuncCallExpr *fc = static_cast<AstFuncCallExpr *>(stmt->getExpression());
+        BuildTailCall(stmt, fc->getArguments(), function);
+        return;
+    }
+    
+    if (stmt->getExpressionCount() == 0) {
+        // Nothing reaches the terminal until the buffer is flushed
+        if (options.bufferedStdout && currentFunc->getName() == "main") {
+            BuildStdout(function);
+            BuildLibraryMethod("java/io/PrintStream", "flush", "()V");
+            builder->CreateInvokeVirtual(function, "flush", "java/io/PrintStream", "()V");
+        }
+        
+        builder->CreateRetVoid(function);
+        return;
+    }
+    
+    DataType type = currentFunc->getDataType();
+    BuildExpr(stmt->getExpression(), function);
+    
+    if (type == DataType::Int64 || type == DataType::UInt64) builder->CreateLRet(function);
+    else if (IsIntType(type)) builder->CreateIRet(function);
+    else builder->CreateARet(function);
 }
 
 // Builds an expression
-void Compiler::BuildExpr(AstExpression *expr, JavaFunction *function, DataType dataType) {
+void Compiler::BuildExpr(AstExpression *expr, JavaFunction *function) {
     switch (expr->getType()) {
+        case AstType::BoolL: {
+            AstBool *b = static_cast<AstBool *>(expr);
+            builder->CreateIConst(function, b->getValue());
+        } break;
+        
+        case AstType::CharL: {
+            AstChar *c = static_cast<AstChar *>(expr);
+            builder->CreateIConst(function, c->getValue());
+        } break;
+        
+        case AstType::ByteL: {
+            AstByte *b = static_cast<AstByte *>(expr);
+            builder->CreateIConst(function, b->getValue());
+        } break;
+        
+        case AstType::WordL: {
+            AstWord *w = static_cast<AstWord *>(expr);
+            builder->CreateIConst(function, w->getValue());
+        } break;
+        
         case AstType::IntL: {
             AstInt *i = static_cast<AstInt *>(expr);
-            builder->CreateBIPush(function, i->getValue());
+            builder->CreateIConst(function, (int)i->getValue());
+        } break;
+        
+        case AstType::QWordL: {
+            AstQWord *i = static_cast<AstQWord *>(expr);
+            builder->CreateLConst(function, (int64_t)i->getValue());
         } break;
     
         case AstType::StringL: {
@@ -186,21 +539,75 @@ void Compiler::BuildExpr(AstExpression *expr, JavaFunction *function, DataType d
         
         case AstType::ID: {
             AstID *id = static_cast<AstID *>(expr);
-            switch (dataType) {
-                case DataType::Int32: {
-                    int pos = intMap[id->getValue()];
-                    builder->CreateILoad(function, pos);
-                } break;
-                
-                default: {
-                    if (intMap.find(id->getValue()) != intMap.end()) {
-                        int pos = intMap[id->getValue()];
-                        builder->CreateILoad(function, pos);
-                    }
-                }
+            if (!locals.IsDefined(id->getValue())) {
+                if (constArrays.find(id->getValue()) != constArrays.end()) BuildArrayRef(id->getValue(), function);
+                break;
             }
+            
+            int pos = locals.GetSlot(id->getValue());
+            DataType type = id->getDataType();
+            if (type == DataType::Int64 || type == DataType::UInt64) builder->CreateLLoad(function, pos);
+            else if (IsIntType(type)) builder->CreateILoad(function, pos);
+            else builder->CreateALoad(function, pos);
+        } break;
+        
+        case AstType::ArrayAccess: {
+            AstArrayAccess *acc = static_cast<AstArrayAccess *>(expr);
+            LocalVar array = GetArray(acc->getValue());
+            
+            BuildArrayRef(acc->getValue(), function);
+            BuildArrayIndex(acc->getValue(), acc->getIndices(), function);
+            BuildArrayLoad(array.subType, function);
+        } break;
+        
+        case AstType::StructAccess: {
+            AstStructAccess *acc = static_cast<AstStructAccess *>(expr);
+            LocalVar field = locals.GetVar(acc->getName() + "." + acc->getMember());
+            
+            if (acc->getIndex()) {
+                builder->CreateALoad(function, field.slot);
+                BuildExpr(acc->getIndex(), function);
+                BuildArrayLoad(field.subType, function);
+            } else {
+                BuildLocalLoad(field, function);
+            }
+        } break;
+        
+        case AstType::Sizeof: {
+            AstSizeof *size = static_cast<AstSizeof *>(expr);
+            AstID *id = size->getValue();
+            std::string name = id->getValue();
+            LocalVar array = GetArray(name);
+            if (id->getSubType() == DataType::Struct) {
+                array = GetFirstField(name, id->getClassName());
+            }
+            
+            if (size->getDimension() < array.dims.size()) {
+                BuildDimension(array.dims[size->getDimension()], function);
+            } else if (array.slot == -1) {
+                builder->CreateIConst(function, constArrays[name]->getValues().size());
+            } else {
+                builder->CreateALoad(function, array.slot);
+                builder->CreateArrayLength(function);
+            }
+        } break;
+        
+        case AstType::FuncCallExpr: {
+            AstFuncCallExpr *fc = static_cast<AstFuncCallExpr *>(expr);
+            BuildCall(fc->getName(), fc->getObjectName(), fc->getArguments(), function);
+        } break;
+        
+        case AstType::Neg: {
+            AstNegOp *op = static_cast<AstNegOp *>(expr);
+            BuildExpr(op->getVal(), function);
+            
+            DataType type = op->getDataType();
+            if (type == DataType::Int64 || type == DataType::UInt64) builder->CreateLNeg(function);
+            else builder->CreateINeg(function);
         } break;
         
+        case AstType::Convert: BuildConvert(static_cast<AstConvertOp *>(expr), function); break;
+        
         case AstType::Add: 
         case AstType::Sub:
         case AstType::Mul:
@@ -211,9 +618,27 @@ void Compiler::BuildExpr(AstExpression *expr, JavaFunction *function, DataType d
         case AstType::Xor:
         case AstType::Lsh:
         case AstType::Rsh: {
+            if (expr->getDataType() == DataType::String) {
+                BuildConcat(expr, function);
+                break;
+            }
+            
             AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
-            BuildExpr(op->getLVal(), function, dataType);
-            BuildExpr(op->getRVal(), function, dataType);
+            BuildExpr(op->getLVal(), function);
+            BuildExpr(op->getRVal(), function);
+            
+            DataType type = op->getDataType();
+            bool isUnsigned = (type == DataType::UInt32 || type == DataType::UInt64);
+            
+            if (isUnsigned && (expr->getType() == AstType::Div || expr->getType() == AstType::Rem)) {
+                BuildUnsignedDivide(expr->getType(), type, function);
+                break;
+            }
+            
+            if (type == DataType::Int64 || type == DataType::UInt64) {
+                BuildLongOp(expr->getType(), isUnsigned, function);
+                break;
+            }
             
             // Math
             if (expr->getType() == AstType::Add)
@@ -236,30 +661,256 @@ void Compiler::BuildExpr(AstExpression *expr, JavaFunction *function, DataType d
                 builder->CreateIXor(function);
             else if (expr->getType() == AstType::Lsh)
                 builder->CreateIShl(function);
+            else if (expr->getType() == AstType::Rsh && isUnsigned)
+                builder->CreateIUShr(function);
             else if (expr->getType() == AstType::Rsh)
                 builder->CreateIShr(function);
         } break;
         
+        case AstType::EQ:
+        case AstType::NEQ:
+        case AstType::GT:
+        case AstType::LT:
+        case AstType::GTE:
+        case AstType::LTE: BuildCompare(expr, function); break;
+        
         default: {}
     }
 }
 
-// Returns a type value for an expression
-std::string Compiler::GetTypeForExpr(AstExpression *expr) {
-    switch (expr->getType()) {
-        case AstType::IntL: return "I";
-        case AstType::StringL: return "Ljava/lang/String;";
+// Collects the operands of a chain of string +
+static void GetConcatParts(AstExpression *expr, std::vector<AstExpression *> &parts) {
+    if (expr->getType() == AstType::Add && expr->getDataType() == DataType::String) {
+        AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+        GetConcatParts(op->getLVal(), parts);
+        GetConcatParts(op->getRVal(), parts);
+    } else {
+        parts.push_back(expr);
+    }
+}
+
+// Builds a string concatenation
+// A whole chain of + becomes one invokedynamic to StringConcatFactory, with
+// string literals copied into its recipe. Java 8 class files (and chains too
+// long for one call site) use a StringBuilder instead.
+void Compiler::BuildConcat(AstExpression *expr, JavaFunction *function) {
+    std::vector<AstExpression *> parts;
+    GetConcatParts(expr, parts);
+    
+    // The recipe marks arguments with \1 and constants with \2
+    auto isConstant = [](AstExpression *part) {
+        if (part->getType() != AstType::StringL) return false;
+        std::string value = static_cast<AstString *>(part)->getValue();
+        return value.find('\1') == std::string::npos && value.find('\2') == std::string::npos;
+    };
+    
+    // A call site takes at most 200 argument slots
+    int slots = 0;
+    for (AstExpression *part : parts) {
+        if (!isConstant(part)) slots += IsLongExpr(part) ? 2 : 1;
+    }
+    
+    if (options.target >= 53 && slots <= 200) {
+        std::string recipe = "";
+        std::string signature = "";
         
-        case AstType::ID: {
-            AstID *id = static_cast<AstID *>(expr);
-            
-            if (intMap.find(id->getValue()) != intMap.end()) {
-                return "I";
+        for (AstExpression *part : parts) {
+            if (isConstant(part)) {
+                recipe += static_cast<AstString *>(part)->getValue();
+            } else {
+                recipe += '\1';
+                signature += BuildStringValue(part, function);
             }
+        }
+        
+        builder->CreateConcat(function, recipe, "(" + signature + ")Ljava/lang/String;");
+        return;
+    }
+    
+    BuildLibraryMethod("java/lang/StringBuilder", "<init>", "()V");
+    builder->CreateNew(function, "java/lang/StringBuilder");
+    builder->CreateDup(function);
+    builder->CreateInvokeSpecial(function, "<init>", "java/lang/StringBuilder", "()V");
+    
+    for (AstExpression *part : parts) {
+        std::string type = BuildStringValue(part, function);
+        if (type[0] == '[' || (type[0] == 'L' && type != "Ljava/lang/String;")) type = "Ljava/lang/Object;";
+        
+        std::string signature = "(" + type + ")Ljava/lang/StringBuilder;";
+        BuildLibraryMethod("java/lang/StringBuilder", "append", signature);
+        builder->CreateInvokeVirtual(function, "append", "java/lang/StringBuilder", signature);
+    }
+    
+    BuildLibraryMethod("java/lang/StringBuilder", "toString", "()Ljava/lang/String;");
+    builder->CreateInvokeVirtual(function, "toString", "java/lang/StringBuilder", "()Ljava/lang/String;");
+}
+
+// Builds a value that's about to be turned into a string, and returns its type
+// There are no unsigned overloads to call, so a uint is widened to the long
+// with the same value, and a uint64 goes through Long.toUnsignedString.
+std::string Compiler::BuildStringValue(AstExpression *expr, JavaFunction *function) {
+    BuildExpr(expr, function);
+    
+    if (expr->getDataType() == DataType::UInt32) {
+        builder->CreateI2L(function);
+        builder->CreateLConst(function, 0xFFFFFFFFL);
+        builder->CreateLAnd(function);
+        return "J";
+    } else if (expr->getDataType() == DataType::UInt64) {
+        BuildLibraryCall("java/lang/Long", "toUnsignedString", "(J)Ljava/lang/String;", function);
+        return "Ljava/lang/String;";
+    }
+    
+    return GetTypeForExpr(expr);
+}
+
+// Builds a long arithmetic or logical instruction
+// Both operands (and only the left one, for shifts) are already longs.
+void Compiler::BuildLongOp(AstType type, bool isUnsigned, JavaFunction *function) {
+    switch (type) {
+        case AstType::Add: builder->CreateLAdd(function); break;
+        case AstType::Sub: builder->CreateLSub(function); break;
+        case AstType::Mul: builder->CreateLMul(function); break;
+        case AstType::Div: builder->CreateLDiv(function); break;
+        case AstType::Rem: builder->CreateLRem(function); break;
+        case AstType::And: builder->CreateLAnd(function); break;
+        case AstType::Or: builder->CreateLOr(function); break;
+        case AstType::Xor: builder->CreateLXor(function); break;
+        case AstType::Lsh: builder->CreateLShl(function); break;
+        case AstType::Rsh: {
+            if (isUnsigned) builder->CreateLUShr(function);
+            else builder->CreateLShr(function);
         } break;
         
         default: {}
     }
+}
 
-    return "V";
+// Builds an unsigned division or remainder
+// The JVM has no instruction for these, but HotSpot turns the library
+// methods into a single unsigned divide.
+void Compiler::BuildUnsignedDivide(AstType type, DataType dataType, JavaFunction *function) {
+    std::string name = type == AstType::Div ? "divideUnsigned" : "remainderUnsigned";
+    
+    if (dataType == DataType::UInt64) BuildLibraryCall("java/lang/Long", name, "(JJ)J", function);
+    else BuildLibraryCall("java/lang/Integer", name, "(II)I", function);
+}
+
+// Calls a static method from the class library
+void Compiler::BuildLibraryCall(std::string baseClass, std::string name, std::string signature, JavaFunction *function) {
+    BuildLibraryMethod(baseClass, name, signature);
+    builder->CreateInvokeStatic(function, name, baseClass, signature);
+}
+
+// Imports a method from the class library
+// Each one is only added to the constant pool once it's used.
+void Compiler::BuildLibraryMethod(std::string baseClass, std::string name, std::string signature) {
+    if (builder->FindMethod(name, baseClass, signature) == 0) {
+        builder->ImportMethod(baseClass, name, signature);
+    }
+}
+
+// Builds a conversion put in by the type checker
+// Longs are truncated with l2i first; narrowing to a sub-word type then wraps
+// the int the same way storing it to a variable of that type would.
+void Compiler::BuildConvert(AstConvertOp *op, JavaFunction *function) {
+    DataType from = op->getVal()->getDataType();
+    DataType to = op->getDataType();
+    bool fromLong = (from == DataType::Int64 || from == DataType::UInt64);
+    bool toLong = (to == DataType::Int64 || to == DataType::UInt64);
+    
+    BuildExpr(op->getVal(), function);
+    
+    // An unsigned int is zero-extended, like Integer.toUnsignedLong
+    if (toLong) {
+        if (!fromLong) builder->CreateI2L(function);
+        if (from == DataType::UInt32) {
+            builder->CreateLConst(function, 0xFFFFFFFFL);
+            builder->CreateLAnd(function);
+        }
+        return;
+    }
+    
+    if (fromLong) builder->CreateL2I(function);
+    
+    switch (to) {
+        case DataType::Byte: builder->CreateI2B(function); break;
+        case DataType::Short: builder->CreateI2S(function); break;
+        
+        case DataType::Char:
+        case DataType::UShort: builder->CreateI2C(function); break;
+        
+        case DataType::UByte: {
+            builder->CreateIConst(function, 0xFF);
+            builder->CreateIAnd(function);
+        } break;
+        
+        default: {}
+    }
+}
+
+// Loads an element from an array, using the load for the element type
+// The array and index should already be on the stack
+void Compiler::BuildArrayLoad(DataType type, JavaFunction *function) {
+    switch (type) {
+        case DataType::Bool:
+        case DataType::Byte: builder->CreateBALoad(function); break;
+        
+        case DataType::UByte: {
+            builder->CreateBALoad(function);
+            builder->CreateIConst(function, 0xFF);
+            builder->CreateIAnd(function);
+        } break;
+        
+        case DataType::Char:
+        case DataType::UShort: builder->CreateCALoad(function); break;
+        
+        case DataType::Short: builder->CreateSALoad(function); break;
+        
+        case DataType::Int32:
+        case DataType::UInt32: builder->CreateIALoad(function); break;
+        
+        case DataType::Int64:
+        case DataType::UInt64: builder->CreateLALoad(function); break;
+        
+        default: builder->CreateAALoad(function);
+    }
+}
+
+// Stores an element into an array
+// The array, index, and value should already be on the stack
+void Compiler::BuildArrayStore(DataType type, JavaFunction *function) {
+    switch (type) {
+        case DataType::Bool:
+        case DataType::Byte:
+        case DataType::UByte: builder->CreateBAStore(function); break;
+        
+        case DataType::Char:
+        case DataType::UShort: builder->CreateCAStore(function); break;
+        
+        case DataType::Short: builder->CreateSAStore(function); break;
+        
+        case DataType::Int32:
+        case DataType::UInt32: builder->CreateIAStore(function); break;
+        
+        case DataType::Int64:
+        case DataType::UInt64: builder->CreateLAStore(function); break;
+        
+        default: builder->CreateAAStore(function);
+    }
+}
+
+// Returns the type a value of some type has on the stack
+// Everything narrower than an int is an int there, except where println has its
+// own overload (boolean and char).
+static std::string GetValueType(DataType type, DataType subType = DataType::Void) {
+    if (type == DataType::Bool) return "Z";
+    if (type == DataType::Char) return "C";
+    if (IsIntType(type)) return "I";
+    return GetDescriptor(type, subType);
+}
+
+// Returns a type value for an expression
+std::string Compiler::GetTypeForExpr(AstExpression *expr) {
+    return GetValueType(expr->getDataType(), expr->getSubType());
 }
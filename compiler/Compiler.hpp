@@ -7,37 +7,179 @@
 
 #include <string>
 #include <map>
+#include <set>
+#include <vector>
 
 #include <ast.hpp>
 
 #include <Java/JavaBuilder.hpp>
+#include <Slots.hpp>
+#include <Fold.hpp>
 
 std::string GetClassName(std::string input);
+bool IsIntType(DataType type);
+JavaArrayType GetArrayType(DataType type);
+std::string GetDescriptor(DataType type, DataType subType = DataType::Void);
+std::string GetSignature(AstFunction *func);
+
+// Options that control code generation
+struct CompilerOptions {
+    bool peephole = true;
+    bool fold = true;
+    int target = 53;            // Class file version; 52 is Java 8
+    bool bufferedStdout = false;
+    bool inlining = true;
+    int inlineThreshold = 35;   // Bytes of bytecode; HotSpot's MaxInlineSize
+    bool splitting = true;
+    int hugeMethodLimit = 8000; // Bytes of bytecode; HotSpot's HugeMethodLimit
+};
+
+// A variable a split-off run of statements can see
+struct SplitVar {
+    DataType type = DataType::Void;
+    DataType subType = DataType::Void;
+    bool movable = true;        // False for objects, structures, and multi-dimensional arrays
+    bool assigned = true;       // False between a declaration and its first assignment
+};
+
+// A run of statements being grown to move into a helper
+struct SplitRun {
+    std::set<std::string> names;
+    std::set<std::string> assigned;
+    std::map<std::string, SplitVar> declared;
+    std::vector<std::string> params;
+    std::vector<std::string> results;   // Variables it sets that are needed afterwards
+    std::set<std::string> pending;      // Declared, but not assigned yet
+    int size = 0;
+    int end = 0;
+};
 
 class Compiler {
 public:
-    explicit Compiler(std::string className);
+    explicit Compiler(std::string className, CompilerOptions options = CompilerOptions());
     void Build(AstTree *tree);
-    void Write();
+    bool Write();
+    void PrintStats();
+    void PrintInlineReport();
+    void PrintTailCallReport();
+    void PrintSplitReport();
 protected:
     void BuildFunction(AstGlobalStatement *GS);
+    void BuildFunctionBody(AstFunction *funcAst, JavaFunction *function);
+    void BuildBlock(AstBlock *block, JavaFunction *function);
     void BuildStatement(AstStatement *stmt, JavaFunction *function);
     
     void BuildVarDec(AstStatement *stmt, JavaFunction *function);
     void BuildVarAssign(AstStatement *stmt, JavaFunction *function);
+    void BuildArrayAssign(AstStatement *stmt, JavaFunction *function);
     void BuildFuncCallStatement(AstStatement *stmt, JavaFunction *function);
-    void BuildExpr(AstExpression *expr, JavaFunction *function, DataType dataType = DataType::Void);
+    DataType BuildCall(std::string name, std::string objectName, std::vector<AstExpression *> args, JavaFunction *function);
+    void BuildReturn(AstStatement *stmt, JavaFunction *function);
+    void BuildExpr(AstExpression *expr, JavaFunction *function);
+    void BuildConvert(AstConvertOp *op, JavaFunction *function);
+    void BuildConcat(AstExpression *expr, JavaFunction *function);
+    std::string BuildStringValue(AstExpression *expr, JavaFunction *function);
+    void BuildLongOp(AstType type, bool isUnsigned, JavaFunction *function);
+    void BuildUnsignedDivide(AstType type, DataType dataType, JavaFunction *function);
+    void BuildLibraryCall(std::string baseClass, std::string name, std::string signature, JavaFunction *function);
+    void BuildLibraryMethod(std::string baseClass, std::string name, std::string signature);
+    void BuildStaticInit();
+    void BuildStdoutInit(JavaFunction *init);
+    void BuildStdout(JavaFunction *function);
+    void BuildArrayLoad(DataType type, JavaFunction *function);
+    void BuildArrayStore(DataType type, JavaFunction *function);
+    
+    // Array.cpp
+    void BuildArraySize(AstVarDec *vd, JavaFunction *function);
+    void BuildDimension(ArrayDim dim, JavaFunction *function);
+    void BuildScale(ArrayDim dim, JavaFunction *function);
+    void BuildArrayIndex(std::string name, std::vector<AstExpression *> indices, JavaFunction *function);
+    LocalVar GetArray(std::string name);
+    void BuildArrayRef(std::string name, JavaFunction *function);
+    void BuildConstArray(AstConstArray *array, JavaFunction *init);
+    void BuildPackedArray(AstConstArray *array, JavaFunction *init);
+    std::vector<std::string> HoistRowOffsets(AstStatement *loop, JavaFunction *function);
+    void ReleaseRowOffsets(std::vector<std::string> hoisted);
+    
+    // Struct.cpp
+    void BuildLocalLoad(LocalVar var, JavaFunction *function);
+    void BuildLocalStore(LocalVar var, JavaFunction *function);
+    void BuildStructDec(AstStatement *stmt, JavaFunction *function);
+    void BuildStructAssign(AstStatement *stmt, JavaFunction *function);
+    void BuildStructCopy(AstVarAssign *va, JavaFunction *function);
+    void BuildStructArray(AstStructDec *sd, JavaFunction *function);
+    void BuildFill(LocalVar array, AstExpression *value, JavaFunction *function);
+    LocalVar GetFirstField(std::string name, std::string structName);
+    
+    // Dispatch.cpp
+    void FindStaticMethods();
+    bool IsStaticMethod(std::string name);
+    
+    // Flow.cpp
+    void BuildIf(AstStatement *stmt, JavaFunction *function);
+    bool BuildSwitch(AstIfStmt *cond, JavaFunction *function);
+    void BuildWhile(AstStatement *stmt, JavaFunction *function);
+    void BuildRepeat(AstStatement *stmt, JavaFunction *function);
+    void BuildFor(AstStatement *stmt, JavaFunction *function);
+    void BuildForAll(AstStatement *stmt, JavaFunction *function);
+    void BuildLoopCtrl(AstStatement *stmt, JavaFunction *function);
+    bool IsSelfCall(std::string name, std::string objectName);
+    void FindTailCalls(std::vector<AstStatement *> block);
+    void BuildTailCall(AstStatement *stmt, std::vector<AstExpression *> args, JavaFunction *function);
+    void BuildCondition(AstExpression *expr, JavaFunction *function, int label, bool jumpIfTrue = false);
+    void BuildCompareCondition(AstExpression *expr, JavaFunction *function, int label, bool jumpIfTrue);
+    void BuildLogicalCondition(AstExpression *expr, JavaFunction *function, int label, bool jumpIfTrue);
+    void BuildCompare(AstExpression *expr, JavaFunction *function);
+    bool IsBoolExpr(AstExpression *expr);
+    bool IsLongExpr(AstExpression *expr);
+    bool IsUnsignedExpr(AstExpression *expr);
+    void BuildCompareOperand(AstExpression *expr, bool isUnsigned, JavaFunction *function);
+    
+    // Split.cpp
+    void SplitFunction(AstFunction *funcAst, JavaFunction *function, int reported);
+    int GetStatementSize(AstStatement *stmt);
+    void SplitBlock(AstFunction *funcAst, AstBlock *block, std::map<std::string, SplitVar> scope,
+                    bool nested, std::vector<AstFunction *> &helpers);
+    void SplitNested(AstFunction *funcAst, AstStatement *stmt, std::map<std::string, SplitVar> scope,
+                     std::vector<AstFunction *> &helpers);
+    std::vector<AstStatement *> OutlineRun(AstFunction *funcAst, std::vector<AstStatement *> stmts,
+                                           std::map<std::string, SplitVar> &scope, SplitRun &run,
+                                           std::vector<AstFunction *> &helpers);
     
     std::string GetTypeForExpr(AstExpression *expr);
 private:
     std::string className;
+    CompilerOptions options;
     JavaClassBuilder *builder;
     std::map<std::string, JavaFunction *> funcMap;
+    std::map<std::string, AstFunction *> funcAsts;
+    std::set<std::string> staticMethods;
+    AstFunction *currentFunc = nullptr;
+    std::map<std::string, AstStruct *> structs;
+    std::map<std::string, AstConstArray *> constArrays;
+    
+    SlotAllocator locals;
+    
+    // The targets for break and continue in the innermost loop
+    std::vector<int> breakLabels;
+    std::vector<int> continueLabels;
+    
+    // Calls a function makes to itself as its last action, which jump back to
+    // tailEntry at the top instead
+    std::set<AstStatement *> tailCalls;
+    int tailEntry = -1;
+    std::vector<std::string> tailCallReport;
+    
+    // Row offsets of multi-dimensional arrays worked out ahead of a loop
+    // The key is "array[index]"; the value is the slot holding index * columns
+    std::map<std::string, int> rowOffsets;
     
-    int aCount = 1;
-    std::map<std::string, int> objMap;
-    std::map<std::string, std::string> objTypeMap;
+    // Where the code for each statement starts and ends in the code vector,
+    // and where each instruction starts in bytes, for measuring what to split
+    std::map<AstStatement *, std::pair<int, int>> codeRanges;
+    std::vector<int> codeOffsets;
+    std::set<std::string> splitHelpers;
+    std::vector<std::string> splitReport;
     
-    int iCount = 1;
-    std::map<std::string, int> intMap;
+    AstFolder folder;
 };
@@ -0,0 +1,83 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Dispatch.cpp
+// Nothing can extend a class we generate, so every method is final and a call
+// to one of our own methods only ever has one target. Calls through "this" and
+// calls to private methods are bound with invokespecial instead of going through
+// the vtable, and private methods that never use "this" become static.
+//
+// Only private methods are made static: anything else can be called from
+// another class, which will use invokevirtual.
+#include <set>
+
+#include <Compiler.hpp>
+#include <Walk.hpp>
+
+// Collects the methods called on "this", whether it's written or not
+class ThisCallFinder : public AstWalker {
+public:
+    ThisCallFinder(std::set<std::string> &calls) : calls(calls) {}
+protected:
+    bool Visit(AstStatement *stmt) {
+        if (stmt->getType() == AstType::FuncCallStmt) {
+            AstFuncCallStmt *fc = static_cast<AstFuncCallStmt *>(stmt);
+            if (fc->getObjectName() == "" || fc->getObjectName() == "this") calls.insert(fc->getName());
+        }
+        return true;
+    }
+
+    bool Visit(AstExpression *expr) {
+        if (expr->getType() == AstType::FuncCallExpr) {
+            AstFuncCallExpr *fc = static_cast<AstFuncCallExpr *>(expr);
+            if (fc->getObjectName() == "" || fc->getObjectName() == "this") calls.insert(fc->getName());
+        }
+        return true;
+    }
+private:
+    std::set<std::string> &calls;
+};
+
+// Works out which private methods can be static
+// A method needs "this" if it calls an instance method on it. Starting from
+// every private method, drop the ones that do until nothing changes, so a
+// method that only calls other static candidates stays static.
+void Compiler::FindStaticMethods() {
+    std::map<std::string, std::set<std::string>> thisCalls;
+
+    for (auto entry : funcAsts) {
+        AstFunction *func = entry.second;
+        if (func->isRoutine() || func->getAttribute() != Attr::Private) continue;
+
+        ThisCallFinder finder(thisCalls[func->getName()]);
+        finder.Walk(func->getBlock()->getBlock());
+        staticMethods.insert(func->getName());
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (auto entry : thisCalls) {
+            if (staticMethods.find(entry.first) == staticMethods.end()) continue;
+
+            for (std::string callee : entry.second) {
+                if (funcAsts.find(callee) == funcAsts.end()) continue;
+                if (funcAsts[callee]->isRoutine() || IsStaticMethod(callee)) continue;
+
+                staticMethods.erase(entry.first);
+                changed = true;
+                break;
+            }
+        }
+    }
+}
+
+// Returns true if a method is built without a receiver
+bool Compiler::IsStaticMethod(std::string name) {
+    if (funcAsts.find(name) == funcAsts.end()) return false;
+    if (funcAsts[name]->isRoutine()) return true;
+    return staticMethods.find(name) != staticMethods.end();
+}
@@ -0,0 +1,382 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Eval.cpp
+// An interpreter for pure routines, so calls to them with constant arguments can
+// be folded. Values are kept the way the folder keeps literals: ints (and
+// everything narrower) as their sign-extended 32-bit value, longs as 64 bits.
+#include <Eval.hpp>
+#include <Fold.hpp>
+#include <Walk.hpp>
+
+// Returns true for the types a pure routine can work with
+static bool IsScalar(DataType type) {
+    switch (type) {
+        case DataType::Bool:
+        case DataType::Char:
+        case DataType::Byte:
+        case DataType::UByte:
+        case DataType::Short:
+        case DataType::UShort:
+        case DataType::Int32:
+        case DataType::UInt32:
+        case DataType::Int64:
+        case DataType::UInt64: return true;
+
+        default: {}
+    }
+
+    return false;
+}
+
+static bool IsLong(AstExpression *expr) {
+    return expr->getDataType() == DataType::Int64 || expr->getDataType() == DataType::UInt64;
+}
+
+static bool IsUnsigned(AstExpression *expr) {
+    return expr->getDataType() == DataType::UInt32 || expr->getDataType() == DataType::UInt64;
+}
+
+//
+// Purity
+//
+
+// Checks a routine's body for anything a pure routine can't do
+// The routines it calls are collected, since they have to be pure too.
+class PurityCheck : public AstWalker {
+public:
+    PurityCheck(std::set<std::string> &calls) : calls(calls) {}
+protected:
+    bool Visit(AstStatement *stmt);
+    bool Visit(AstExpression *expr);
+private:
+    std::set<std::string> &calls;
+};
+
+// Finds the pure routines in the tree
+// Every routine that passes on its own is a candidate; then any that call
+// something that isn't a candidate are dropped until nothing changes.
+void AstEvaluator::Load(AstTree *tree) {
+    std::map<std::string, std::set<std::string>> calls;
+
+    for (AstGlobalStatement *GS : tree->getGlobalStatements()) {
+        if (GS->getType() != AstType::Func) continue;
+
+        AstFunction *func = static_cast<AstFunction *>(GS);
+        functions[func->getName()] = func;
+
+        if (!func->isRoutine() || !IsScalar(func->getDataType())) continue;
+
+        bool ok = true;
+        for (Var arg : func->getArguments()) ok = ok && IsScalar(arg.type);
+        PurityCheck check(calls[func->getName()]);
+        if (!ok || !check.Walk(func->getBlock()->getBlock())) continue;
+
+        pure.insert(func->getName());
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (auto entry : calls) {
+            if (!IsPure(entry.first)) continue;
+
+            for (std::string callee : entry.second) {
+                if (IsPure(callee)) continue;
+
+                pure.erase(entry.first);
+                changed = true;
+                break;
+            }
+        }
+    }
+}
+
+bool PurityCheck::Visit(AstStatement *stmt) {
+    switch (stmt->getType()) {
+        case AstType::VarDec: return IsScalar(static_cast<AstVarDec *>(stmt)->getDataType());
+
+        case AstType::If:
+        case AstType::Elif:
+        case AstType::Else:
+        case AstType::While:
+        case AstType::Repeat:
+        case AstType::For:
+        case AstType::VarAssign:
+        case AstType::Return:
+        case AstType::Break:
+        case AstType::Continue: return true;
+
+        default: {}
+    }
+
+    return false;
+}
+
+bool PurityCheck::Visit(AstExpression *expr) {
+    switch (expr->getType()) {
+        case AstType::BoolL:
+        case AstType::CharL:
+        case AstType::ByteL:
+        case AstType::WordL:
+        case AstType::IntL:
+        case AstType::QWordL:
+        case AstType::Neg:
+        case AstType::Convert: return true;
+
+        case AstType::ID: return IsScalar(expr->getDataType());
+
+        case AstType::FuncCallExpr: {
+            AstFuncCallExpr *fc = static_cast<AstFuncCallExpr *>(expr);
+            if (fc->getObjectName() != "") return false;
+
+            calls.insert(fc->getName());
+            return true;
+        }
+
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Mul:
+        case AstType::Div:
+        case AstType::Rem:
+        case AstType::And:
+        case AstType::Or:
+        case AstType::Xor:
+        case AstType::Lsh:
+        case AstType::Rsh:
+        case AstType::EQ:
+        case AstType::NEQ:
+        case AstType::GT:
+        case AstType::LT:
+        case AstType::GTE:
+        case AstType::LTE: {
+            AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+            return IsScalar(op->getLVal()->getDataType()) && IsScalar(op->getRVal()->getDataType());
+        }
+
+        default: {}
+    }
+
+    return false;
+}
+
+//
+// The interpreter
+//
+
+// Runs a pure routine with a fresh budget
+bool AstEvaluator::Call(std::string name, std::vector<int64_t> args, int64_t &result) {
+    if (!IsPure(name)) return false;
+
+    steps = 0;
+    return Invoke(functions[name], args, result, 0);
+}
+
+bool AstEvaluator::Invoke(AstFunction *func, std::vector<int64_t> args, int64_t &result, int depth) {
+    if (depth > maxDepth) return false;
+
+    std::vector<Var> params = func->getArguments();
+    if (params.size() != args.size()) return false;
+
+    std::map<std::string, EvalVar> vars;
+    for (int i = 0; i<params.size(); i++) {
+        vars[params[i].name].value = args[i];
+        vars[params[i].name].type = params[i].type;
+    }
+
+    if (RunBlock(func->getBlock()->getBlock(), vars, result, depth) != Return) return false;
+
+    result = ConvertValue(result, func->getDataType(), func->getDataType());
+    return true;
+}
+
+AstEvaluator::Flow AstEvaluator::RunBlock(std::vector<AstStatement *> block, std::map<std::string, EvalVar> &vars, int64_t &result, int depth) {
+    for (AstStatement *stmt : block) {
+        Flow flow = RunStatement(stmt, vars, result, depth);
+        if (flow != Next) return flow;
+    }
+
+    return Next;
+}
+
+AstEvaluator::Flow AstEvaluator::RunStatement(AstStatement *stmt, std::map<std::string, EvalVar> &vars, int64_t &result, int depth) {
+    if (++steps > maxSteps) return Fail;
+
+    int64_t value = 0;
+
+    switch (stmt->getType()) {
+        case AstType::VarDec: {
+            AstVarDec *vd = static_cast<AstVarDec *>(stmt);
+            vars[vd->getName()].value = 0;
+            vars[vd->getName()].type = vd->getDataType();
+        } break;
+
+        case AstType::VarAssign: {
+            AstVarAssign *va = static_cast<AstVarAssign *>(stmt);
+            if (vars.find(va->getName()) == vars.end()) return Fail;
+            if (!Evaluate(va->getExpression(), vars, value, depth)) return Fail;
+
+            EvalVar &var = vars[va->getName()];
+            var.value = ConvertValue(value, var.type, var.type);
+        } break;
+
+        case AstType::Return: {
+            if (stmt->getExpressionCount() == 0) return Fail;
+            if (!Evaluate(stmt->getExpression(), vars, result, depth)) return Fail;
+            return Return;
+        }
+
+        case AstType::Break: return Break;
+        case AstType::Continue: return Continue;
+
+        case AstType::If: {
+            AstIfStmt *cond = static_cast<AstIfStmt *>(stmt);
+            if (!Evaluate(cond->getExpression(), vars, value, depth)) return Fail;
+            if (value != 0) return RunBlock(cond->getBlock(), vars, result, depth);
+
+            for (AstStatement *branch : cond->getBranches()) {
+                if (branch->getType() == AstType::Elif) {
+                    if (!Evaluate(branch->getExpression(), vars, value, depth)) return Fail;
+                    if (value == 0) continue;
+                }
+
+                return RunBlock(static_cast<AstBlockStmt *>(branch)->getBlock(), vars, result, depth);
+            }
+        } break;
+
+        // A repeat only ends with a break
+        case AstType::While:
+        case AstType::Repeat: {
+            AstBlockStmt *loop = static_cast<AstBlockStmt *>(stmt);
+
+            for (;;) {
+                if (stmt->getType() == AstType::While) {
+                    if (!Evaluate(loop->getExpression(), vars, value, depth)) return Fail;
+                    if (value == 0) break;
+                }
+
+                Flow flow = RunBlock(loop->getBlock(), vars, result, depth);
+                if (flow == Break) break;
+                if (flow == Return || flow == Fail) return flow;
+                if (++steps > maxSteps) return Fail;
+            }
+        } break;
+
+        // The end is worked out once, and isn't part of the range
+        case AstType::For: {
+            AstForStmt *loop = static_cast<AstForStmt *>(stmt);
+            std::string index = loop->getIndex()->getValue();
+            int step = (int)loop->getStep()->getValue();
+
+            int64_t end = 0;
+            if (!Evaluate(loop->getStartBound(), vars, value, depth)) return Fail;
+            if (!Evaluate(loop->getEndBound(), vars, end, depth)) return Fail;
+
+            if (vars.find(index) == vars.end()) vars[index].type = DataType::Int32;
+            vars[index].value = (int32_t)value;
+
+            while (step < 0 ? vars[index].value > end : vars[index].value < end) {
+                Flow flow = RunBlock(loop->getBlock(), vars, result, depth);
+                if (flow == Break) break;
+                if (flow == Return || flow == Fail) return flow;
+                if (++steps > maxSteps) return Fail;
+
+                vars[index].value = (int32_t)(vars[index].value + step);
+            }
+        } break;
+
+        default: return Fail;
+    }
+
+    return Next;
+}
+
+bool AstEvaluator::Evaluate(AstExpression *expr, std::map<std::string, EvalVar> &vars, int64_t &value, int depth) {
+    if (++steps > maxSteps) return false;
+
+    bool isLong = false;
+    if (GetLiteralValue(expr, value, isLong)) return true;
+
+    switch (expr->getType()) {
+        case AstType::ID: {
+            std::string name = static_cast<AstID *>(expr)->getValue();
+            if (vars.find(name) == vars.end()) return false;
+            value = vars[name].value;
+            return true;
+        }
+
+        case AstType::Neg: {
+            AstExpression *val = static_cast<AstUnaryOp *>(expr)->getVal();
+            if (!Evaluate(val, vars, value, depth)) return false;
+            return ComputeBinary(AstType::Sub, 0, value, IsLong(val), false, value);
+        }
+
+        case AstType::Convert: {
+            AstExpression *val = static_cast<AstUnaryOp *>(expr)->getVal();
+            if (!Evaluate(val, vars, value, depth)) return false;
+            value = ConvertValue(value, val->getDataType(), expr->getDataType());
+            return true;
+        }
+
+        case AstType::FuncCallExpr: {
+            AstFuncCallExpr *fc = static_cast<AstFuncCallExpr *>(expr);
+            if (!IsPure(fc->getName())) return false;
+
+            AstFunction *callee = functions[fc->getName()];
+            std::vector<Var> params = callee->getArguments();
+            std::vector<AstExpression *> args = fc->getArguments();
+            if (params.size() != args.size()) return false;
+
+            std::vector<int64_t> values;
+            for (int i = 0; i<args.size(); i++) {
+                int64_t arg = 0;
+                if (!Evaluate(args[i], vars, arg, depth)) return false;
+                values.push_back(ConvertValue(arg, args[i]->getDataType(), params[i].type));
+            }
+
+            return Invoke(callee, values, value, depth + 1);
+        }
+
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Mul:
+        case AstType::Div:
+        case AstType::Rem:
+        case AstType::And:
+        case AstType::Or:
+        case AstType::Xor:
+        case AstType::Lsh:
+        case AstType::Rsh:
+        case AstType::EQ:
+        case AstType::NEQ:
+        case AstType::GT:
+        case AstType::LT:
+        case AstType::GTE:
+        case AstType::LTE: break;
+
+        default: return false;
+    }
+
+    AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+    int64_t lval = 0, rval = 0;
+    if (!Evaluate(op->getLVal(), vars, lval, depth)) return false;
+
+    // Logical and and or don't look at the right side if they don't need to
+    if (op->getDataType() == DataType::Bool) {
+        if (op->getType() == AstType::And && lval == 0) {
+            value = 0;
+            return true;
+        } else if (op->getType() == AstType::Or && lval != 0) {
+            value = 1;
+            return true;
+        }
+    }
+
+    if (!Evaluate(op->getRVal(), vars, rval, depth)) return false;
+
+    bool wide = IsLong(op->getLVal()) || IsLong(op->getRVal());
+    return ComputeBinary(op->getType(), lval, rval, wide, IsUnsigned(op->getLVal()), value);
+}
@@ -0,0 +1,55 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+#include <cstdint>
+
+#include <ast.hpp>
+
+// A local variable while evaluating
+struct EvalVar {
+    int64_t value = 0;
+    DataType type = DataType::Void;
+};
+
+// Compile-time evaluation of pure routines
+// A routine is pure if it only works on integer and bool values: it prints
+// nothing, creates no objects or arrays, and only calls other pure routines.
+// A call to one with constant arguments can be run here and replaced with its
+// result. Each call gets a budget of steps and a limit on how deep it can
+// recurse; if it runs out (or would throw, like dividing by zero), the call is
+// left for runtime.
+class AstEvaluator {
+public:
+    void Load(AstTree *tree);
+    bool IsPure(std::string name) { return pure.find(name) != pure.end(); }
+    bool Call(std::string name, std::vector<int64_t> args, int64_t &result);
+protected:
+    // What a statement does to the flow of the routine running it
+    enum Flow {
+        Next,
+        Return,
+        Break,
+        Continue,
+        Fail
+    };
+
+    bool Invoke(AstFunction *func, std::vector<int64_t> args, int64_t &result, int depth);
+    Flow RunBlock(std::vector<AstStatement *> block, std::map<std::string, EvalVar> &vars, int64_t &result, int depth);
+    Flow RunStatement(AstStatement *stmt, std::map<std::string, EvalVar> &vars, int64_t &result, int depth);
+    bool Evaluate(AstExpression *expr, std::map<std::string, EvalVar> &vars, int64_t &value, int depth);
+private:
+    std::map<std::string, AstFunction *> functions;
+    std::set<std::string> pure;
+    int steps = 0;
+
+    const int maxSteps = 100000;
+    const int maxDepth = 64;
+};
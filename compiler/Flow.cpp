@@ -0,0 +1,669 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <utility>
+
+#include <Compiler.hpp>
+
+// Returns the if_icmp branch for a comparison
+static JavaBranch GetCompareBranch(AstType type) {
+    switch (type) {
+        case AstType::EQ: return B_IF_ICMPEQ;
+        case AstType::NEQ: return B_IF_ICMPNE;
+        case AstType::GT: return B_IF_ICMPGT;
+        case AstType::LT: return B_IF_ICMPLT;
+        case AstType::GTE: return B_IF_ICMPGE;
+        case AstType::LTE: return B_IF_ICMPLE;
+
+        default: {}
+    }
+
+    return B_IF_ICMPNE;
+}
+
+// Returns the branch for comparing a value with zero
+static JavaBranch GetZeroBranch(AstType type) {
+    switch (type) {
+        case AstType::EQ: return B_IFEQ;
+        case AstType::NEQ: return B_IFNE;
+        case AstType::GT: return B_IFGT;
+        case AstType::LT: return B_IFLT;
+        case AstType::GTE: return B_IFGE;
+        case AstType::LTE: return B_IFLE;
+
+        default: {}
+    }
+
+    return B_IFNE;
+}
+
+// Returns the comparison with the operands swapped (a < b -> b > a)
+static AstType GetMirroredCompare(AstType type) {
+    switch (type) {
+        case AstType::GT: return AstType::LT;
+        case AstType::LT: return AstType::GT;
+        case AstType::GTE: return AstType::LTE;
+        case AstType::LTE: return AstType::GTE;
+
+        default: {}
+    }
+
+    return type;
+}
+
+// Returns the variable and value of an "x = <constant>" test
+// Enum members and constants are literals by the time we see them.
+static bool GetSwitchCase(AstExpression *expr, std::string &name, int &value) {
+    if (expr->getType() != AstType::EQ) return false;
+
+    AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+    AstExpression *lval = op->getLVal();
+    AstExpression *rval = op->getRVal();
+    if (lval->getType() != AstType::ID) std::swap(lval, rval);
+    if (lval->getType() != AstType::ID) return false;
+
+    int64_t literal = 0;
+    bool isLong = false;
+    if (!GetLiteralValue(rval, literal, isLong) || isLong) return false;
+
+    name = static_cast<AstID *>(lval)->getValue();
+    value = (int)literal;
+    return true;
+}
+
+// Builds a conditional statement
+// Each branch tests its condition and jumps to the next branch if it's false
+void Compiler::BuildIf(AstStatement *stmt, JavaFunction *function) {
+    AstIfStmt *cond = static_cast<AstIfStmt *>(stmt);
+    if (BuildSwitch(cond, function)) return;
+
+    int endLabel = builder->CreateLabel(function);
+    int nextLabel = builder->CreateLabel(function);
+
+    BuildCondition(cond->getExpression(), function, nextLabel);
+    BuildBlock(cond->getBlockStmt(), function);
+
+    for (AstStatement *branch : cond->getBranches()) {
+        builder->CreateGoto(function, endLabel);
+        builder->SetLabel(function, nextLabel);
+        nextLabel = builder->CreateLabel(function);
+
+        if (branch->getType() == AstType::Elif) {
+            BuildCondition(branch->getExpression(), function, nextLabel);
+        }
+
+        AstBlockStmt *block = static_cast<AstBlockStmt *>(branch);
+        BuildBlock(block->getBlockStmt(), function);
+    }
+
+    builder->SetLabel(function, nextLabel);
+    builder->SetLabel(function, endLabel);
+}
+
+// Builds an if/elif chain as a switch
+// This works if every condition compares the same int variable against a
+// constant. The first branch for a value wins, like in the chain, and any else
+// block becomes the default. Returns false if the chain doesn't fit.
+bool Compiler::BuildSwitch(AstIfStmt *cond, JavaFunction *function) {
+    std::vector<AstStatement *> branches = cond->getBranches();
+    AstBlockStmt *elseBlock = nullptr;
+    if (!branches.empty() && branches.back()->getType() == AstType::Else) {
+        elseBlock = static_cast<AstBlockStmt *>(branches.back());
+        branches.pop_back();
+    }
+
+    // A couple of compares is no worse than a switch
+    if (branches.size() + 1 < 3) return false;
+
+    std::string name = "";
+    int value = 0;
+    if (!GetSwitchCase(cond->getExpression(), name, value)) return false;
+    if (!locals.IsDefined(name) || !IsIntType(locals.GetVar(name).type)) return false;
+
+    std::vector<AstBlockStmt *> blocks;
+    std::vector<int> values;
+    blocks.push_back(cond);
+    values.push_back(value);
+
+    for (AstStatement *branch : branches) {
+        std::string branchName = "";
+        if (branch->getType() != AstType::Elif) return false;
+        if (!GetSwitchCase(branch->getExpression(), branchName, value)) return false;
+        if (branchName != name) return false;
+
+        blocks.push_back(static_cast<AstBlockStmt *>(branch));
+        values.push_back(value);
+    }
+
+    int endLabel = builder->CreateLabel(function);
+    int defaultLabel = builder->CreateLabel(function);
+    std::map<int, int> cases;
+    std::vector<int> labels;
+
+    for (int i = 0; i<blocks.size(); i++) {
+        int label = builder->CreateLabel(function);
+        labels.push_back(label);
+        if (cases.find(values[i]) == cases.end()) cases[values[i]] = label;
+    }
+
+    builder->CreateILoad(function, locals.GetSlot(name));
+    builder->CreateSwitch(function, cases, defaultLabel);
+
+    for (int i = 0; i<blocks.size(); i++) {
+        if (cases[values[i]] != labels[i]) continue;
+
+        builder->SetLabel(function, labels[i]);
+        BuildBlock(blocks[i]->getBlockStmt(), function);
+        builder->CreateGoto(function, endLabel);
+    }
+
+    builder->SetLabel(function, defaultLabel);
+    if (elseBlock) BuildBlock(elseBlock->getBlockStmt(), function);
+    builder->SetLabel(function, endLabel);
+
+    return true;
+}
+
+// Builds a while loop
+// The loop is bottom-tested: we jump to the condition at the end, and the
+// condition jumps back to the top. That way each iteration only has one branch.
+void Compiler::BuildWhile(AstStatement *stmt, JavaFunction *function) {
+    AstWhileStmt *loop = static_cast<AstWhileStmt *>(stmt);
+
+    int bodyLabel = builder->CreateLabel(function);
+    int condLabel = builder->CreateLabel(function);
+    int endLabel = builder->CreateLabel(function);
+
+    std::vector<std::string> hoisted = HoistRowOffsets(loop, function);
+    builder->CreateGoto(function, condLabel);
+    builder->SetLabel(function, bodyLabel);
+
+    breakLabels.push_back(endLabel);
+    continueLabels.push_back(condLabel);
+    BuildBlock(loop->getBlockStmt(), function);
+    breakLabels.pop_back();
+    continueLabels.pop_back();
+
+    builder->SetLabel(function, condLabel);
+    BuildCondition(loop->getExpression(), function, bodyLabel, true);
+    builder->SetLabel(function, endLabel);
+    ReleaseRowOffsets(hoisted);
+}
+
+// Builds an infinite loop
+void Compiler::BuildRepeat(AstStatement *stmt, JavaFunction *function) {
+    AstRepeatStmt *loop = static_cast<AstRepeatStmt *>(stmt);
+
+    int bodyLabel = builder->CreateLabel(function);
+    int endLabel = builder->CreateLabel(function);
+
+    builder->SetLabel(function, bodyLabel);
+
+    breakLabels.push_back(endLabel);
+    continueLabels.push_back(bodyLabel);
+    BuildBlock(loop->getBlockStmt(), function);
+    breakLabels.pop_back();
+    continueLabels.pop_back();
+
+    builder->CreateGoto(function, bodyLabel);
+    builder->SetLabel(function, endLabel);
+}
+
+// Builds a for loop
+// The range is half-open, so "for i in 0 .. 10" runs i from 0 through 9. The
+// index is only declared for the loop if it isn't a variable already.
+//
+// This is the shape HotSpot treats as a counted loop: one int induction
+// variable stepped by an iinc, an end bound that doesn't change (evaluated
+// once, into its own slot unless it's a constant), and the exit test at the
+// bottom.
+void Compiler::BuildFor(AstStatement *stmt, JavaFunction *function) {
+    AstForStmt *loop = static_cast<AstForStmt *>(stmt);
+    std::string index = loop->getIndex()->getValue();
+    int step = (int)loop->getStep()->getValue();
+
+    locals.EnterScope();
+    if (!locals.IsDefined(index)) locals.Allocate(index, DataType::Int32);
+    int indexPos = locals.GetSlot(index);
+
+    int bodyLabel = builder->CreateLabel(function);
+    int stepLabel = builder->CreateLabel(function);
+    int condLabel = builder->CreateLabel(function);
+    int endLabel = builder->CreateLabel(function);
+
+    BuildExpr(loop->getStartBound(), function);
+    builder->CreateIStore(function, indexPos);
+
+    int64_t endValue = 0;
+    bool isLong = false;
+    bool constEnd = GetLiteralValue(loop->getEndBound(), endValue, isLong);
+    int endPos = -1;
+    if (!constEnd) {
+        endPos = locals.AllocateTemp();
+        BuildExpr(loop->getEndBound(), function);
+        builder->CreateIStore(function, endPos);
+    }
+
+    std::vector<std::string> hoisted = HoistRowOffsets(loop, function);
+    builder->CreateGoto(function, condLabel);
+    builder->SetLabel(function, bodyLabel);
+
+    breakLabels.push_back(endLabel);
+    continueLabels.push_back(stepLabel);
+    BuildBlock(loop->getBlockStmt(), function);
+    breakLabels.pop_back();
+    continueLabels.pop_back();
+
+    builder->SetLabel(function, stepLabel);
+    builder->CreateIInc(function, indexPos, step);
+
+    builder->SetLabel(function, condLabel);
+    builder->CreateILoad(function, indexPos);
+    if (constEnd) builder->CreateIConst(function, (int)endValue);
+    else builder->CreateILoad(function, endPos);
+    builder->CreateBranch(function, step < 0 ? B_IF_ICMPGT : B_IF_ICMPLT, bodyLabel);
+    builder->SetLabel(function, endLabel);
+
+    ReleaseRowOffsets(hoisted);
+    if (endPos != -1) locals.ReleaseTemp(endPos);
+    locals.ExitScope();
+}
+
+// Builds a forall loop over an array
+// The array reference and its length are loaded once, into their own slots,
+// and we walk it with a hidden int index. The loop variable is a plain local
+// holding the current element, so writing to it doesn't touch the array.
+void Compiler::BuildForAll(AstStatement *stmt, JavaFunction *function) {
+    AstForAllStmt *loop = static_cast<AstForAllStmt *>(stmt);
+    std::string element = loop->getIndex()->getValue();
+    LocalVar array = GetArray(loop->getArray()->getValue());
+
+    locals.EnterScope();
+    int arrayPos = locals.AllocateTemp();
+    int lengthPos = locals.AllocateTemp();
+    int indexPos = locals.AllocateTemp();
+
+    DataType type = array.subType;
+    std::string className = type == DataType::String ? "java/lang/String" : "";
+    int elementPos = locals.Allocate(element, type, DataType::Void, className);
+
+    int bodyLabel = builder->CreateLabel(function);
+    int stepLabel = builder->CreateLabel(function);
+    int condLabel = builder->CreateLabel(function);
+    int endLabel = builder->CreateLabel(function);
+
+    BuildArrayRef(loop->getArray()->getValue(), function);
+    builder->CreateDup(function);
+    builder->CreateAStore(function, arrayPos);
+    builder->CreateArrayLength(function);
+    builder->CreateIStore(function, lengthPos);
+    builder->CreateIConst(function, 0);
+    builder->CreateIStore(function, indexPos);
+
+    std::vector<std::string> hoisted = HoistRowOffsets(loop, function);
+    builder->CreateGoto(function, condLabel);
+
+    builder->SetLabel(function, bodyLabel);
+    builder->CreateALoad(function, arrayPos);
+    builder->CreateILoad(function, indexPos);
+    BuildArrayLoad(type, function);
+
+    if (IsIntType(type)) builder->CreateIStore(function, elementPos);
+    else if (type == DataType::Int64 || type == DataType::UInt64) builder->CreateLStore(function, elementPos);
+    else builder->CreateAStore(function, elementPos);
+
+    breakLabels.push_back(endLabel);
+    continueLabels.push_back(stepLabel);
+    BuildBlock(loop->getBlockStmt(), function);
+    breakLabels.pop_back();
+    continueLabels.pop_back();
+
+    builder->SetLabel(function, stepLabel);
+    builder->CreateIInc(function, indexPos, 1);
+
+    builder->SetLabel(function, condLabel);
+    builder->CreateILoad(function, indexPos);
+    builder->CreateILoad(function, lengthPos);
+    builder->CreateBranch(function, B_IF_ICMPLT, bodyLabel);
+    builder->SetLabel(function, endLabel);
+
+    ReleaseRowOffsets(hoisted);
+    locals.ReleaseTemp(indexPos);
+    locals.ReleaseTemp(lengthPos);
+    locals.ReleaseTemp(arrayPos);
+    locals.ExitScope();
+}
+
+// Builds a break or continue statement
+// The type checker makes sure we're inside a loop.
+void Compiler::BuildLoopCtrl(AstStatement *stmt, JavaFunction *function) {
+    if (stmt->getType() == AstType::Break) {
+        builder->CreateGoto(function, breakLabels.back());
+    } else {
+        builder->CreateGoto(function, continueLabels.back());
+    }
+}
+
+// Returns true if a call goes back into the function being built
+bool Compiler::IsSelfCall(std::string name, std::string objectName) {
+    if (name != currentFunc->getName()) return false;
+    if (objectName == "") return true;
+    return objectName == "this" && !IsStaticMethod(name);
+}
+
+// Finds the calls a function makes to itself as its last action
+// That's "return f(...)", or "f(...)" right before a plain return.
+void Compiler::FindTailCalls(std::vector<AstStatement *> block) {
+    for (int i = 0; i<block.size(); i++) {
+        AstStatement *stmt = block[i];
+        
+        if (stmt->getType() == AstType::Return && stmt->getExpressionCount() == 1) {
+            AstExpression *expr = stmt->getExpression();
+            if (expr->getType() == AstType::FuncCallExpr) {
+                AstFuncCallExpr *fc = static_cast<AstFuncCallExpr *>(expr);
+                if (IsSelfCall(fc->getName(), fc->getObjectName())) tailCalls.insert(stmt);
+            }
+        } else if (stmt->getType() == AstType::FuncCallStmt && i + 1 < block.size()) {
+            AstFuncCallStmt *fc = static_cast<AstFuncCallStmt *>(stmt);
+            AstStatement *next = block[i + 1];
+            
+            if (next->getType() == AstType::Return && next->getExpressionCount() == 0 && IsSelfCall(fc->getName(), fc->getObjectName())) {
+                tailCalls.insert(stmt);
+            }
+        }
+        
+        switch (stmt->getType()) {
+            case AstType::If: {
+                for (AstStatement *branch : static_cast<AstIfStmt *>(stmt)->getBranches()) {
+                    FindTailCalls(static_cast<AstBlockStmt *>(branch)->getBlock());
+                }
+            } // fallthrough
+            
+            case AstType::While:
+            case AstType::Repeat:
+            case AstType::For:
+            case AstType::ForAll: FindTailCalls(static_cast<AstBlockStmt *>(stmt)->getBlock()); break;
+            
+            default: {}
+        }
+    }
+}
+
+// Builds a call a function makes to itself as its last action
+// The JVM has no tail calls, so the arguments are stored over the parameters
+// and we jump back to the start. Every argument is built before any parameter
+// is written, since they can read the old values; one that passes a parameter
+// straight back through is left alone.
+void Compiler::BuildTailCall(AstStatement *stmt, std::vector<AstExpression *> args, JavaFunction *function) {
+    std::vector<Var> params = currentFunc->getArguments();
+    std::vector<bool> same;
+    
+    for (int i = 0; i<args.size(); i++) {
+        AstExpression *arg = args[i];
+        same.push_back(arg->getType() == AstType::ID && static_cast<AstID *>(arg)->getValue() == params[i].name);
+        if (!same[i]) BuildExpr(arg, function);
+    }
+    
+    for (int i = args.size() - 1; i >= 0; i--) {
+        if (!same[i]) BuildLocalStore(locals.GetVar(params[i].name), function);
+    }
+    
+    builder->CreateGoto(function, tailEntry);
+    
+    tailCallReport.push_back(currentFunc->getName() + " (line " + std::to_string(stmt->getLine()) + "): converted to a loop");
+}
+
+// Builds a condition that jumps to a label
+// By default, the jump is taken if the condition is false. Comparisons branch
+// directly on their operands rather than building a 0/1 value and testing it.
+void Compiler::BuildCondition(AstExpression *expr, JavaFunction *function, int label, bool jumpIfTrue) {
+    // A constant condition is either a goto or nothing at all
+    int64_t value = 0;
+    bool isLong = false;
+    if (GetLiteralValue(expr, value, isLong)) {
+        if ((value != 0) == jumpIfTrue) builder->CreateGoto(function, label);
+        return;
+    }
+
+    switch (expr->getType()) {
+        case AstType::EQ:
+        case AstType::NEQ:
+        case AstType::GT:
+        case AstType::LT:
+        case AstType::GTE:
+        case AstType::LTE: {
+            BuildCompareCondition(expr, function, label, jumpIfTrue);
+            return;
+        }
+
+        case AstType::And:
+        case AstType::Or: {
+            if (IsBoolExpr(expr)) {
+                BuildLogicalCondition(expr, function, label, jumpIfTrue);
+                return;
+            }
+        } break;
+
+        default: {}
+    }
+
+    BuildExpr(expr, function);
+    builder->CreateBranch(function, jumpIfTrue ? B_IFNE : B_IFEQ, label);
+}
+
+// Builds a comparison as a single branch
+void Compiler::BuildCompareCondition(AstExpression *expr, JavaFunction *function, int label, bool jumpIfTrue) {
+    AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+    AstType type = expr->getType();
+    AstExpression *lval = op->getLVal();
+    AstExpression *rval = op->getRVal();
+
+    int64_t value = 0;
+    bool isLong = false;
+
+    // Keep any constant on the right
+    if (GetLiteralValue(lval, value, isLong) && !GetLiteralValue(rval, value, isLong)) {
+        std::swap(lval, rval);
+        type = GetMirroredCompare(type);
+    }
+
+    // Longs are compared with lcmp, then its result against zero
+    // Ordering unsigned values needs their sign bits flipped first.
+    bool isUnsigned = IsUnsignedExpr(lval) && type != AstType::EQ && type != AstType::NEQ;
+    if (IsLongExpr(lval) || isUnsigned) {
+        BuildCompareOperand(lval, isUnsigned, function);
+        BuildCompareOperand(rval, isUnsigned, function);
+
+        JavaBranch branch = GetCompareBranch(type);
+        if (IsLongExpr(lval)) {
+            builder->CreateLCmp(function);
+            branch = GetZeroBranch(type);
+        }
+
+        if (!jumpIfTrue) branch = (JavaBranch)InvertBranch(branch);
+        builder->CreateBranch(function, branch, label);
+        return;
+    }
+
+    if (GetLiteralValue(rval, value, isLong)) {
+        // Parser::checkCondExpression turns "if x" into "x = 1". For a boolean
+        // that's just x, so test it directly.
+        if ((type == AstType::EQ || type == AstType::NEQ) && (value == 0 || value == 1) && IsBoolExpr(lval)) {
+            bool sameAsValue = (type == AstType::EQ) == (value == 1);
+            BuildCondition(lval, function, label, sameAsValue == jumpIfTrue);
+            return;
+        }
+
+        // Comparisons with zero have their own branches
+        if (value == 0) {
+            BuildExpr(lval, function);
+
+            JavaBranch branch = GetZeroBranch(type);
+            if (!jumpIfTrue) branch = (JavaBranch)InvertBranch(branch);
+            builder->CreateBranch(function, branch, label);
+            return;
+        }
+    }
+
+    BuildExpr(lval, function);
+    BuildExpr(rval, function);
+
+    JavaBranch branch = GetCompareBranch(type);
+    if (!jumpIfTrue) branch = (JavaBranch)InvertBranch(branch);
+    builder->CreateBranch(function, branch, label);
+}
+
+// Builds a short-circuit "and" or "or"
+// Only the left side is always evaluated; if it decides the result, the right
+// side is skipped.
+void Compiler::BuildLogicalCondition(AstExpression *expr, JavaFunction *function, int label, bool jumpIfTrue) {
+    AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+    bool isAnd = expr->getType() == AstType::And;
+
+    // "and" jumping if false, or "or" jumping if true: either side can take the jump
+    if (isAnd != jumpIfTrue) {
+        BuildCondition(op->getLVal(), function, label, jumpIfTrue);
+        BuildCondition(op->getRVal(), function, label, jumpIfTrue);
+        return;
+    }
+
+    // Otherwise, the left side can only skip past the right one
+    int skipLabel = builder->CreateLabel(function);
+    BuildCondition(op->getLVal(), function, skipLabel, !jumpIfTrue);
+    BuildCondition(op->getRVal(), function, label, jumpIfTrue);
+    builder->SetLabel(function, skipLabel);
+}
+
+// Builds a comparison as a value (1 if true, 0 if false)
+// This doesn't branch. The operands are widened to long and compared with lcmp,
+// which gives -1, 0, or 1; the result is then turned into a 0/1 with bit tricks.
+// Widening means the subtraction inside lcmp can't overflow. Longs go to lcmp
+// as they are.
+void Compiler::BuildCompare(AstExpression *expr, JavaFunction *function) {
+    AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+    AstType type = expr->getType();
+    AstExpression *lval = op->getLVal();
+    AstExpression *rval = op->getRVal();
+
+    int64_t value = 0;
+    bool isLong = false;
+
+    if (GetLiteralValue(lval, value, isLong) && !GetLiteralValue(rval, value, isLong)) {
+        std::swap(lval, rval);
+        type = GetMirroredCompare(type);
+    }
+
+    bool longOperands = IsLongExpr(lval);
+    bool isUnsigned = IsUnsignedExpr(lval) && type != AstType::EQ && type != AstType::NEQ;
+
+    // x < 0 and x >= 0 are just the sign bit
+    bool signTest = !isUnsigned && (type == AstType::LT || type == AstType::GTE);
+    if (signTest && GetLiteralValue(rval, value, isLong) && value == 0) {
+        BuildExpr(lval, function);
+        if (longOperands) {
+            builder->CreateIConst(function, 63);
+            builder->CreateLUShr(function);
+            builder->CreateL2I(function);
+        } else {
+            builder->CreateIConst(function, 31);
+            builder->CreateIUShr(function);
+        }
+        if (type == AstType::GTE) {
+            builder->CreateIConst(function, 1);
+            builder->CreateIXor(function);
+        }
+        return;
+    }
+
+    BuildCompareOperand(lval, isUnsigned, function);
+    if (!longOperands) builder->CreateI2L(function);
+
+    if (longOperands) {
+        BuildCompareOperand(rval, isUnsigned, function);
+    } else if (GetLiteralValue(rval, value, isLong) && !isUnsigned) {
+        builder->CreateLConst(function, value);
+    } else {
+        BuildCompareOperand(rval, isUnsigned, function);
+        builder->CreateI2L(function);
+    }
+
+    builder->CreateLCmp(function);
+
+    switch (type) {
+        // -1 -> 1, others -> 0
+        case AstType::LT:
+        case AstType::GTE: {
+            builder->CreateIConst(function, 31);
+            builder->CreateIUShr(function);
+        } break;
+
+        // 1 -> 1, others -> 0
+        case AstType::GT:
+        case AstType::LTE: {
+            builder->CreateINeg(function);
+            builder->CreateIConst(function, 31);
+            builder->CreateIUShr(function);
+        } break;
+
+        // -1 and 1 -> 1, 0 -> 0
+        case AstType::EQ:
+        case AstType::NEQ: {
+            builder->CreateIConst(function, 1);
+            builder->CreateIAnd(function);
+        } break;
+
+        default: {}
+    }
+
+    // The rest are the opposite of one of the above
+    if (type == AstType::GTE || type == AstType::LTE || type == AstType::EQ) {
+        builder->CreateIConst(function, 1);
+        builder->CreateIXor(function);
+    }
+}
+
+// Returns true if an expression is a boolean (0 or 1) value
+bool Compiler::IsBoolExpr(AstExpression *expr) {
+    return expr->getDataType() == DataType::Bool;
+}
+
+// Builds one side of a comparison
+// Flipping the sign bit of both sides makes a signed compare give the unsigned
+// order, the same as Integer.compareUnsigned. Literals are flipped here.
+void Compiler::BuildCompareOperand(AstExpression *expr, bool isUnsigned, JavaFunction *function) {
+    if (!isUnsigned) {
+        BuildExpr(expr, function);
+        return;
+    }
+
+    int64_t value = 0;
+    bool isLong = false;
+    bool longOperand = IsLongExpr(expr);
+
+    if (GetLiteralValue(expr, value, isLong)) {
+        if (longOperand) builder->CreateLConst(function, value ^ INT64_MIN);
+        else builder->CreateIConst(function, (int32_t)value ^ INT32_MIN);
+        return;
+    }
+
+    BuildExpr(expr, function);
+    if (longOperand) {
+        builder->CreateLConst(function, INT64_MIN);
+        builder->CreateLXor(function);
+    } else {
+        builder->CreateIConst(function, INT32_MIN);
+        builder->CreateIXor(function);
+    }
+}
+
+// Returns true if an expression is an unsigned int or long
+bool Compiler::IsUnsignedExpr(AstExpression *expr) {
+    return expr->getDataType() == DataType::UInt32 || expr->getDataType() == DataType::UInt64;
+}
+
+// Returns true if an expression is a long value
+bool Compiler::IsLongExpr(AstExpression *expr) {
+    return expr->getDataType() == DataType::Int64 || expr->getDataType() == DataType::UInt64;
+}
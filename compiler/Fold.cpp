@@ -0,0 +1,561 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <vector>
+
+#include <Fold.hpp>
+
+//
+// Helpers
+//
+
+// Returns the value of a literal expression
+// Sub-word literals all become int arithmetic, like they do in Java
+bool GetLiteralValue(AstExpression *expr, int64_t &value, bool &isLong) {
+    isLong = false;
+
+    switch (expr->getType()) {
+        case AstType::BoolL: value = static_cast<AstBool *>(expr)->getValue(); break;
+        case AstType::CharL: value = static_cast<AstChar *>(expr)->getValue(); break;
+        case AstType::ByteL: value = static_cast<AstByte *>(expr)->getValue(); break;
+        case AstType::WordL: value = static_cast<AstWord *>(expr)->getValue(); break;
+        case AstType::IntL: value = (int32_t)static_cast<AstInt *>(expr)->getValue(); break;
+        case AstType::QWordL: {
+            value = (int64_t)static_cast<AstQWord *>(expr)->getValue();
+            isLong = true;
+        } break;
+
+        default: return false;
+    }
+
+    return true;
+}
+
+// Creates a literal node
+// The parser shares const and enum nodes between every use, so we always create
+// new nodes rather than changing existing ones
+AstExpression *MakeLiteral(int64_t value, bool isLong) {
+    if (isLong) return new AstQWord((uint64_t)value);
+    return new AstInt((uint64_t)(int64_t)(int32_t)value);
+}
+
+// Returns whether an expression can be dropped without changing behavior
+// Calls can have side effects and array accesses can throw
+bool IsPureExpr(AstExpression *expr) {
+    switch (expr->getType()) {
+        case AstType::BoolL:
+        case AstType::CharL:
+        case AstType::ByteL:
+        case AstType::WordL:
+        case AstType::IntL:
+        case AstType::QWordL:
+        case AstType::StringL:
+        case AstType::ID: return true;
+
+        case AstType::Neg:
+        case AstType::Convert: return IsPureExpr(static_cast<AstUnaryOp *>(expr)->getVal());
+
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Mul:
+        case AstType::And:
+        case AstType::Or:
+        case AstType::Xor:
+        case AstType::Lsh:
+        case AstType::Rsh: {
+            AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+            return IsPureExpr(op->getLVal()) && IsPureExpr(op->getRVal());
+        }
+
+        default: {}
+    }
+
+    return false;
+}
+
+// Returns whether an expression is known to never be negative
+static bool IsNonNegative(AstExpression *expr) {
+    int64_t value = 0;
+    bool isLong = false;
+    if (GetLiteralValue(expr, value, isLong)) return value >= 0;
+
+    switch (expr->getType()) {
+        case AstType::Sizeof: return true;
+
+        // x & mask is non-negative if the mask is
+        case AstType::And: {
+            AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+            return IsNonNegative(op->getLVal()) || IsNonNegative(op->getRVal());
+        }
+
+        // A non-negative value stays that way when shifted right
+        case AstType::Rsh: return IsNonNegative(static_cast<AstBinaryOp *>(expr)->getLVal());
+
+        default: {}
+    }
+
+    return false;
+}
+
+// Returns log2 of a value if it is a power of two, or -1 otherwise
+static int GetPowerOfTwo(int64_t value) {
+    if (value <= 0 || (value & (value - 1)) != 0) return -1;
+
+    int shift = 0;
+    while (value > 1) {
+        value >>= 1;
+        ++shift;
+    }
+    return shift;
+}
+
+static bool IsUnsigned(AstExpression *expr) {
+    return expr->getDataType() == DataType::UInt32 || expr->getDataType() == DataType::UInt64;
+}
+
+static bool IsSameID(AstExpression *lval, AstExpression *rval) {
+    if (lval->getType() != AstType::ID || rval->getType() != AstType::ID) return false;
+    return static_cast<AstID *>(lval)->getValue() == static_cast<AstID *>(rval)->getValue();
+}
+
+static AstBinaryOp *MakeBinaryOp(AstType type, AstExpression *lval, AstExpression *rval) {
+    AstBinaryOp *op = nullptr;
+
+    switch (type) {
+        case AstType::Lsh: op = new AstLshOp; break;
+        case AstType::Rsh: op = new AstRshOp; break;
+        case AstType::And: op = new AstAndOp; break;
+        default: return nullptr;
+    }
+
+    op->setLVal(lval);
+    op->setRVal(rval);
+    return op;
+}
+
+// Gives a node made by the folder the type of the one it replaces
+static AstExpression *Retype(AstExpression *expr, AstExpression *from) {
+    expr->setDataType(from->getDataType(), from->getSubType());
+    expr->setClassName(from->getClassName());
+    return expr;
+}
+
+// Converts a value between types the same way the JVM would at runtime
+// A uint widens to a long with its unsigned value.
+int64_t ConvertValue(int64_t value, DataType from, DataType to) {
+    switch (to) {
+        case DataType::Int64:
+        case DataType::UInt64: return from == DataType::UInt32 ? (uint32_t)value : value;
+
+        case DataType::Bool: return value != 0;
+        case DataType::Byte: return (int8_t)value;
+        case DataType::UByte: return (uint8_t)value;
+        case DataType::Short: return (int16_t)value;
+        case DataType::Char:
+        case DataType::UShort: return (uint16_t)value;
+
+        default: return (int32_t)value;
+    }
+}
+
+// Creates a literal holding a value of the given type
+AstExpression *MakeTypedLiteral(int64_t value, DataType type) {
+    AstExpression *literal = nullptr;
+    if (type == DataType::Bool) literal = new AstBool(value != 0);
+    else literal = MakeLiteral(value, type == DataType::Int64 || type == DataType::UInt64);
+
+    literal->setDataType(type);
+    return literal;
+}
+
+//
+// The pass
+//
+
+void AstFolder::Run(AstTree *tree) {
+    evaluator.Load(tree);
+    
+    for (AstGlobalStatement *GS : tree->getGlobalStatements()) {
+        if (GS->getType() == AstType::Func) {
+            AstFunction *func = static_cast<AstFunction *>(GS);
+            FoldBlock(func->getBlock());
+        }
+    }
+}
+
+void AstFolder::FoldBlock(AstBlock *block) {
+    for (AstStatement *stmt : block->getBlock()) {
+        FoldStatement(stmt);
+    }
+}
+
+void AstFolder::FoldStatement(AstStatement *stmt) {
+    std::vector<AstExpression *> exprs = stmt->getExpressions();
+    if (exprs.size() > 0) {
+        stmt->clearExpressions();
+        for (AstExpression *expr : exprs) stmt->addExpression(FoldExpr(expr));
+    }
+
+    switch (stmt->getType()) {
+        case AstType::If: {
+            AstIfStmt *cond = static_cast<AstIfStmt *>(stmt);
+            FoldBlock(cond->getBlockStmt());
+            for (AstStatement *branch : cond->getBranches()) FoldStatement(branch);
+        } break;
+
+        case AstType::For: {
+            AstForStmt *loop = static_cast<AstForStmt *>(stmt);
+            loop->setStartBound(FoldExpr(loop->getStartBound()));
+            loop->setEndBound(FoldExpr(loop->getEndBound()));
+            FoldBlock(loop->getBlockStmt());
+        } break;
+
+        case AstType::Elif:
+        case AstType::Else:
+        case AstType::While:
+        case AstType::Repeat:
+        case AstType::ForAll: {
+            AstBlockStmt *blockStmt = static_cast<AstBlockStmt *>(stmt);
+            FoldBlock(blockStmt->getBlockStmt());
+        } break;
+
+        default: {}
+    }
+}
+
+// Folds an expression tree, bottom up
+// Returns the expression to use in its place
+AstExpression *AstFolder::FoldExpr(AstExpression *expr) {
+    if (expr == nullptr) return nullptr;
+
+    switch (expr->getType()) {
+        case AstType::Neg: {
+            AstNegOp *neg = static_cast<AstNegOp *>(expr);
+            AstExpression *val = FoldExpr(neg->getVal());
+
+            int64_t value = 0;
+            bool isLong = false;
+            if (GetLiteralValue(val, value, isLong)) {
+                ++stats["folded"];
+                return Retype(MakeLiteral((int64_t)(0 - (uint64_t)value), isLong), neg);
+            }
+
+            AstNegOp *op = new AstNegOp;
+            op->setVal(val);
+            return Retype(op, neg);
+        }
+
+        case AstType::Convert: {
+            AstConvertOp *op = static_cast<AstConvertOp *>(expr);
+            op->setVal(FoldExpr(op->getVal()));
+
+            int64_t value = 0;
+            bool isLong = false;
+            if (GetLiteralValue(op->getVal(), value, isLong)) {
+                ++stats["folded"];
+                value = ConvertValue(value, op->getVal()->getDataType(), op->getDataType());
+                return MakeTypedLiteral(value, op->getDataType());
+            }
+        } break;
+
+        case AstType::ArrayAccess: {
+            AstArrayAccess *acc = static_cast<AstArrayAccess *>(expr);
+            std::vector<AstExpression *> indices;
+            for (AstExpression *index : acc->getIndices()) indices.push_back(FoldExpr(index));
+            acc->setIndices(indices);
+        } break;
+
+        case AstType::FuncCallExpr: {
+            AstFuncCallExpr *fc = static_cast<AstFuncCallExpr *>(expr);
+            std::vector<AstExpression *> args = fc->getArguments();
+            fc->clearArguments();
+            for (AstExpression *arg : args) fc->addArgument(FoldExpr(arg));
+            
+            // A pure routine with constant arguments can be run now
+            if (fc->getObjectName() != "" || !evaluator.IsPure(fc->getName())) break;
+            
+            std::vector<int64_t> values;
+            for (AstExpression *arg : fc->getArguments()) {
+                int64_t value = 0;
+                bool isLong = false;
+                if (!GetLiteralValue(arg, value, isLong)) break;
+                values.push_back(value);
+            }
+            
+            int64_t result = 0;
+            if (values.size() != args.size()) break;
+            if (!evaluator.Call(fc->getName(), values, result)) break;
+            
+            ++stats["evaluated"];
+            return MakeTypedLiteral(result, fc->getDataType());
+        } break;
+
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Mul:
+        case AstType::Div:
+        case AstType::Rem:
+        case AstType::And:
+        case AstType::Or:
+        case AstType::Xor:
+        case AstType::Lsh:
+        case AstType::Rsh:
+        case AstType::EQ:
+        case AstType::NEQ:
+        case AstType::GT:
+        case AstType::LT:
+        case AstType::GTE:
+        case AstType::LTE: return FoldBinary(static_cast<AstBinaryOp *>(expr));
+
+        default: {}
+    }
+
+    return expr;
+}
+
+AstExpression *AstFolder::FoldBinary(AstBinaryOp *op) {
+    op->setLVal(FoldExpr(op->getLVal()));
+    op->setRVal(FoldExpr(op->getRVal()));
+
+    // Joining strings isn't arithmetic, and the order matters
+    if (op->getDataType() == DataType::String) return op;
+
+    int64_t lval = 0, rval = 0;
+    bool lLong = false, rLong = false;
+
+    if (GetLiteralValue(op->getLVal(), lval, lLong) && GetLiteralValue(op->getRVal(), rval, rLong)) {
+        bool folded = false;
+        bool isUnsigned = IsUnsigned(op->getLVal());
+        AstExpression *result = FoldLiterals(op->getType(), lval, rval, lLong || rLong, isUnsigned, folded);
+        if (folded) {
+            ++stats["folded"];
+            if (result->getType() == AstType::BoolL) return result;
+            return Retype(result, op);
+        }
+    }
+
+    return Simplify(op);
+}
+
+// Computes a binary operation on two literals using Java semantics
+// Division by zero is left alone so it still throws at runtime.
+AstExpression *AstFolder::FoldLiterals(AstType type, int64_t lval, int64_t rval, bool isLong, bool isUnsigned, bool &folded) {
+    int64_t result = 0;
+    folded = ComputeBinary(type, lval, rval, isLong, isUnsigned, result);
+    if (!folded) return nullptr;
+
+    switch (type) {
+        case AstType::EQ:
+        case AstType::NEQ:
+        case AstType::GT:
+        case AstType::LT:
+        case AstType::GTE:
+        case AstType::LTE: return new AstBool(result != 0);
+
+        default: {}
+    }
+
+    return MakeLiteral(result, isLong);
+}
+
+// Computes a binary operation on two values using Java semantics
+// Comparisons give 0 or 1. Unsigned operands divide, shift, and compare as the
+// unsigned helpers would. Returns false for a division by zero, which has to
+// throw at runtime.
+bool ComputeBinary(AstType type, int64_t lval, int64_t rval, bool isLong, bool isUnsigned, int64_t &result) {
+    if (!isLong) {
+        lval = (int32_t)lval;
+        rval = (int32_t)rval;
+    }
+
+    uint64_t ul = (uint64_t)lval;
+    uint64_t ur = (uint64_t)rval;
+    if (isUnsigned && !isLong) {
+        ul = (uint32_t)lval;
+        ur = (uint32_t)rval;
+    }
+
+    int shiftMask = isLong ? 63 : 31;
+    int64_t minValue = isLong ? INT64_MIN : INT32_MIN;
+
+    if (isUnsigned) {
+        switch (type) {
+            case AstType::Div: if (ur == 0) return false; result = ul / ur; break;
+            case AstType::Rem: if (ur == 0) return false; result = ul % ur; break;
+            case AstType::Rsh: result = ul >> (rval & shiftMask); break;
+
+            case AstType::GT: result = ul > ur; break;
+            case AstType::LT: result = ul < ur; break;
+            case AstType::GTE: result = ul >= ur; break;
+            case AstType::LTE: result = ul <= ur; break;
+
+            default: isUnsigned = false;
+        }
+    }
+
+    if (!isUnsigned) {
+        switch (type) {
+            case AstType::Add: result = ul + ur; break;
+            case AstType::Sub: result = ul - ur; break;
+            case AstType::Mul: result = ul * ur; break;
+
+            // MIN / -1 overflows back to MIN in Java; the remainder is 0
+            case AstType::Div: {
+                if (rval == 0) return false;
+                result = (lval == minValue && rval == -1) ? minValue : lval / rval;
+            } break;
+
+            case AstType::Rem: {
+                if (rval == 0) return false;
+                result = (lval == minValue && rval == -1) ? 0 : lval % rval;
+            } break;
+
+            case AstType::And: result = lval & rval; break;
+            case AstType::Or: result = lval | rval; break;
+            case AstType::Xor: result = lval ^ rval; break;
+            case AstType::Lsh: result = ul << (rval & shiftMask); break;
+            case AstType::Rsh: result = isLong ? lval >> (rval & shiftMask) : (int32_t)lval >> (rval & shiftMask); break;
+
+            case AstType::EQ: result = lval == rval; break;
+            case AstType::NEQ: result = lval != rval; break;
+            case AstType::GT: result = lval > rval; break;
+            case AstType::LT: result = lval < rval; break;
+            case AstType::GTE: result = lval >= rval; break;
+            case AstType::LTE: result = lval <= rval; break;
+
+            default: return false;
+        }
+    }
+
+    if (!isLong) result = (int32_t)result;
+    return true;
+}
+
+// Removes algebraic identities and reduces operations by powers of two
+AstExpression *AstFolder::Simplify(AstBinaryOp *op) {
+    AstExpression *lval = op->getLVal();
+    AstExpression *rval = op->getRVal();
+
+    int64_t value = 0;
+    bool isLong = false;
+    bool rConst = GetLiteralValue(rval, value, isLong);
+
+    // Constant on the left of a commutative op: move it to the right
+    if (!rConst) {
+        switch (op->getType()) {
+            case AstType::Add:
+            case AstType::Mul:
+            case AstType::And:
+            case AstType::Or:
+            case AstType::Xor: {
+                if (GetLiteralValue(lval, value, isLong)) {
+                    op->setLVal(rval);
+                    op->setRVal(lval);
+                    lval = op->getLVal();
+                    rval = op->getRVal();
+                    rConst = true;
+                }
+            } break;
+
+            default: {}
+        }
+    }
+
+    // x - x, x ^ x -> 0
+    if (!rConst) {
+        if ((op->getType() == AstType::Sub || op->getType() == AstType::Xor) && IsSameID(lval, rval)) {
+            ++stats["identity"];
+            return Retype(MakeLiteral(0, lval->getDataType() == DataType::Int64 || lval->getDataType() == DataType::UInt64), op);
+        }
+        return op;
+    }
+
+    if (!isLong) value = (int32_t)value;
+
+    switch (op->getType()) {
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Or:
+        case AstType::Xor:
+        case AstType::Lsh:
+        case AstType::Rsh: {
+            if (value == 0) {
+                ++stats["identity"];
+                return lval;
+            }
+        } break;
+
+        case AstType::Mul: {
+            if (value == 1) {
+                ++stats["identity"];
+                return lval;
+            }
+
+            if (value == 0 && IsPureExpr(lval)) {
+                ++stats["identity"];
+                return Retype(MakeLiteral(0, isLong), op);
+            }
+
+            if (value == -1) {
+                ++stats["strength"];
+                AstNegOp *neg = new AstNegOp;
+                neg->setVal(lval);
+                return Retype(neg, op);
+            }
+
+            // Wrap-around multiplication by 2^k is exactly a left shift
+            int shift = GetPowerOfTwo(value);
+            if (shift > 0) {
+                ++stats["strength"];
+                return Retype(MakeBinaryOp(AstType::Lsh, lval, new AstInt(shift)), op);
+            }
+        } break;
+
+        case AstType::Div: {
+            if (value == 1) {
+                ++stats["identity"];
+                return lval;
+            }
+
+            // Division truncates toward zero, so it only matches an arithmetic
+            // shift when the dividend can't be negative (unsigned shifts are logical)
+            int shift = GetPowerOfTwo(value);
+            if (shift > 0 && (IsNonNegative(lval) || IsUnsigned(op))) {
+                ++stats["strength"];
+                return Retype(MakeBinaryOp(AstType::Rsh, lval, new AstInt(shift)), op);
+            }
+        } break;
+
+        case AstType::Rem: {
+            if (value == 1 && IsPureExpr(lval)) {
+                ++stats["identity"];
+                return Retype(MakeLiteral(0, isLong), op);
+            }
+
+            // Same as division: the remainder takes the sign of the dividend
+            int shift = GetPowerOfTwo(value);
+            if (shift > 0 && (IsNonNegative(lval) || IsUnsigned(op))) {
+                ++stats["strength"];
+                return Retype(MakeBinaryOp(AstType::And, lval, Retype(MakeLiteral(value - 1, isLong), op)), op);
+            }
+        } break;
+
+        case AstType::And: {
+            if (value == -1) {
+                ++stats["identity"];
+                return lval;
+            }
+
+            if (value == 0 && IsPureExpr(lval)) {
+                ++stats["identity"];
+                return Retype(MakeLiteral(0, isLong), op);
+            }
+        } break;
+
+        default: {}
+    }
+
+    return op;
+}
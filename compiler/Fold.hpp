@@ -0,0 +1,43 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <string>
+#include <map>
+#include <cstdint>
+
+#include <ast.hpp>
+#include <Eval.hpp>
+
+// The constant folding pass
+// This runs over the AST between parsing and code generation. It folds literal
+// subtrees (with Java's int/long wrap-around), removes algebraic identities, and
+// turns multiplies, divides, and remainders by powers of two into shifts and masks
+// where that doesn't change the result. Calls to pure routines with constant
+// arguments are run at compile time (see Eval.hpp).
+class AstFolder {
+public:
+    void Run(AstTree *tree);
+
+    AstExpression *FoldExpr(AstExpression *expr);
+    std::map<std::string, int> GetStats() { return stats; }
+protected:
+    void FoldBlock(AstBlock *block);
+    void FoldStatement(AstStatement *stmt);
+    AstExpression *FoldBinary(AstBinaryOp *op);
+    AstExpression *FoldLiterals(AstType type, int64_t lval, int64_t rval, bool isLong, bool isUnsigned, bool &folded);
+    AstExpression *Simplify(AstBinaryOp *op);
+private:
+    std::map<std::string, int> stats;
+    AstEvaluator evaluator;
+};
+
+bool GetLiteralValue(AstExpression *expr, int64_t &value, bool &isLong);
+AstExpression *MakeLiteral(int64_t value, bool isLong);
+AstExpression *MakeTypedLiteral(int64_t value, DataType type);
+int64_t ConvertValue(int64_t value, DataType from, DataType to);
+bool ComputeBinary(AstType type, int64_t lval, int64_t rval, bool isLong, bool isUnsigned, int64_t &result);
+bool IsPureExpr(AstExpression *expr);
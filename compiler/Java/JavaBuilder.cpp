@@ -45,6 +45,51 @@ int JavaClassBuilder::AddUTF8(std::string value) {
     return pos;
 }
 
+// Adds an integer constant to the pool, reusing an existing entry if we have one
+int JavaClassBuilder::AddInteger(int value) {
+    if (intConstMap.find(value) != intConstMap.end()) {
+        return intConstMap[value];
+    }
+    
+    JavaIntegerEntry *entry = new JavaIntegerEntry(value);
+    int pos = java->AddConst(entry);
+    intConstMap[value] = pos;
+    
+    return pos;
+}
+
+// Adds a long constant to the pool, reusing an existing entry if we have one
+int JavaClassBuilder::AddLong(int64_t value) {
+    if (longConstMap.find(value) != longConstMap.end()) {
+        return longConstMap[value];
+    }
+    
+    JavaLongEntry *entry = new JavaLongEntry(value);
+    int pos = java->AddConst(entry);
+    longConstMap[value] = pos;
+    
+    return pos;
+}
+
+// Adds a string constant to the pool, reusing an existing entry if we have one
+int JavaClassBuilder::AddString(std::string value) {
+    if (constMap.find(value) != constMap.end()) {
+        return constMap[value];
+    }
+    
+    int pos = AddUTF8(value);
+    JavaStringEntry *entry = new JavaStringEntry(pos);
+    pos = java->AddConst(entry);
+    constMap[value] = pos;
+    
+    return pos;
+}
+
+// Sets the class file version (52 is Java 8)
+void JavaClassBuilder::SetVersion(int major) {
+    java->major_version = htons(major);
+}
+
 // Imports a class
 int JavaClassBuilder::ImportClass(std::string baseClass) {
    int classPos = 0;
@@ -103,6 +148,7 @@ void JavaClassBuilder::ImportField(std::string baseClass, std::string typeClass,
     int refPos = java->AddConst(ref);
 
     fieldMap[name] = refPos;
+    fieldTypes[refPos] = sig;
 }
 
 // Finds a method in the method table
@@ -128,6 +174,17 @@ int JavaClassBuilder::FindMethod(std::string name, std::string baseClass, std::s
 }
 
 // Writes out the class file
-void JavaClassBuilder::Write(FILE *file) {
+// The code is final at this point, so this is where branches get their offsets
+// and each method gets its max stack and StackMapTable
+// Nothing is written if any method fails.
+bool JavaClassBuilder::Write(FILE *file) {
+    for (JavaFunction *func : java->methods) {
+        RemoveDeadCode(func);
+        LayoutCode(func);
+        if (!ComputeFrames(func)) return false;
+    }
+    
+    if (!java->bootstrapMethods.empty()) java->bootstrapIdx = AddUTF8("BootstrapMethods");
     java->write(file);
+    return true;
 }
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
 #include <arpa/inet.h>
 #include <map>
 #include <vector>
@@ -26,31 +27,82 @@ struct Method {
     }
 };
 
+// The verification types used by StackMapTable frames
+enum JavaVerifyTag {
+    V_TOP = 0,
+    V_INTEGER = 1,
+    V_FLOAT = 2,
+    V_DOUBLE = 3,
+    V_LONG = 4,
+    V_NULL = 5,
+    V_UNINIT_THIS = 6,
+    V_OBJECT = 7,
+    V_UNINIT = 8
+};
+
+struct JavaVerifyType {
+    int tag = V_TOP;
+    std::string className = "";     // V_OBJECT
+    int newPos = 0;                 // V_UNINIT: index of the "new" instruction
+
+    JavaVerifyType(int tag = V_TOP, std::string className = "") {
+        this->tag = tag;
+        this->className = className;
+    }
+
+    bool operator==(const JavaVerifyType &other) const {
+        return tag == other.tag && className == other.className && newPos == other.newPos;
+    }
+    bool operator!=(const JavaVerifyType &other) const { return !(*this == other); }
+};
+
+// The types of the locals and operand stack at a point in a method
+// Longs take up two entries, the second one being V_TOP
+struct JavaFrame {
+    std::vector<JavaVerifyType> locals;
+    std::vector<JavaVerifyType> stack;
+};
+
 class JavaClassBuilder {
 public:
     explicit JavaClassBuilder(std::string className);
     int AddUTF8(std::string value);
+    int AddInteger(int value);
+    int AddLong(int64_t value);
+    int AddString(std::string value);
+    void SetVersion(int major);
     int ImportClass(std::string baseClass);
     void ImportMethod(std::string baseClass, std::string name, std::string signature);
     void ImportField(std::string baseClass, std::string typeClass, std::string name);
     int FindMethod(std::string name, std::string baseClass, std::string signature);
+    bool HasField(std::string name) { return fieldMap.find(name) != fieldMap.end(); }
 
     JavaFunction *CreateMethod(std::string name, std::string signature, int = F_PUBLIC);
+    void CreateField(std::string name, std::string signature, int flags);
     void CreateALoad(JavaFunction *func, int pos);
     void CreateAStore(JavaFunction *func, int pos);
     void CreateNew(JavaFunction *func, std::string name);
     void CreateDup(JavaFunction *func);
+    void CreatePop(JavaFunction *func, int width = 1);
     void CreateGetStatic(JavaFunction *func, std::string name);
+    void CreatePutStatic(JavaFunction *func, std::string name);
     void CreateString(JavaFunction *func, std::string value);
+    void CreatePackedString(JavaFunction *func, std::vector<uint16_t> chars);
+    void CreateLdc(JavaFunction *func, int pos);
     void CreateInvokeSpecial(JavaFunction *func, std::string name, std::string baseClass = "", std::string signature = "");
     void CreateInvokeVirtual(JavaFunction *func, std::string name, std::string baseClass = "", std::string signature = "");
     void CreateInvokeStatic(JavaFunction *func, std::string name, std::string baseClass = "", std::string signature = "");
+    void CreateConcat(JavaFunction *func, std::string recipe, std::string signature);
     void CreateRetVoid(JavaFunction *func);
+    void CreateIRet(JavaFunction *func);
+    void CreateLRet(JavaFunction *func);
+    void CreateARet(JavaFunction *func);
     
     // Integer instructions
-    void CreateBIPush(JavaFunction *func, int value);
+    void CreateIConst(JavaFunction *func, int value);
     void CreateILoad(JavaFunction *func, int value);
     void CreateIStore(JavaFunction *func, int value);
+    void CreateIInc(JavaFunction *func, int pos, int amount);
     void CreateIAdd(JavaFunction *func);
     void CreateISub(JavaFunction *func);
     void CreateIMul(JavaFunction *func);
@@ -61,9 +113,91 @@ public:
     void CreateIXor(JavaFunction *func);
     void CreateIShl(JavaFunction *func);
     void CreateIShr(JavaFunction *func);
+    void CreateIUShr(JavaFunction *func);
+    void CreateINeg(JavaFunction *func);
+    void CreateI2B(JavaFunction *func);
+    void CreateI2C(JavaFunction *func);
+    void CreateI2S(JavaFunction *func);
+    
+    // Long instructions
+    void CreateLConst(JavaFunction *func, int64_t value);
+    void CreateI2L(JavaFunction *func);
+    void CreateL2I(JavaFunction *func);
+    void CreateLAdd(JavaFunction *func);
+    void CreateLSub(JavaFunction *func);
+    void CreateLMul(JavaFunction *func);
+    void CreateLDiv(JavaFunction *func);
+    void CreateLRem(JavaFunction *func);
+    void CreateLAnd(JavaFunction *func);
+    void CreateLOr(JavaFunction *func);
+    void CreateLXor(JavaFunction *func);
+    void CreateLShl(JavaFunction *func);
+    void CreateLShr(JavaFunction *func);
+    void CreateLUShr(JavaFunction *func);
+    void CreateLNeg(JavaFunction *func);
+    void CreateLCmp(JavaFunction *func);
+    void CreateLLoad(JavaFunction *func, int pos);
+    void CreateLStore(JavaFunction *func, int pos);
+    
+    // Array instructions
+    void CreateNewArray(JavaFunction *func, JavaArrayType type);
+    void CreateANewArray(JavaFunction *func, std::string className);
+    void CreateArrayLength(JavaFunction *func);
+    void CreateIALoad(JavaFunction *func);
+    void CreateLALoad(JavaFunction *func);
+    void CreateAALoad(JavaFunction *func);
+    void CreateBALoad(JavaFunction *func);
+    void CreateCALoad(JavaFunction *func);
+    void CreateSALoad(JavaFunction *func);
+    void CreateIAStore(JavaFunction *func);
+    void CreateLAStore(JavaFunction *func);
+    void CreateAAStore(JavaFunction *func);
+    void CreateBAStore(JavaFunction *func);
+    void CreateCAStore(JavaFunction *func);
+    void CreateSAStore(JavaFunction *func);
+    
+    // Branch instructions
+    int CreateLabel(JavaFunction *func);
+    void SetLabel(JavaFunction *func, int label);
+    void CreateBranch(JavaFunction *func, JavaBranch branch, int label);
+    void CreateGoto(JavaFunction *func, int label);
+    void CreateSwitch(JavaFunction *func, std::map<int, int> cases, int defaultLabel);
+
+    // JavaInline.cpp
+    void RunInliner(int threshold, int maxSize);
+    std::vector<std::string> GetInlineReport() { return inlineReport; }
+    
+    // JavaPeephole.cpp
+    int RunPeephole(JavaFunction *func);
+    void RunPeephole();
+    bool GetIntConst(JavaCode &code, int &value);
+    bool GetStackEffect(JavaCode &code, int &pops, int &pushes);
+    int GetPeepholeSaved() { return peepholeSaved; }
+    std::map<std::string, int> GetPeepholeHits() { return peepholeHits; }
+    
+    static JavaCode EncodeLocalOp(int shortOp, int op, int pos);
+    static bool EncodeIConst(int value, JavaCode &code);
+    static bool EncodeIInc(int pos, int amount, JavaCode &code);
 
-    void Write(FILE *file);
+    bool Write(FILE *file);
 private:
+    void CreateLocalOp(JavaFunction *func, int shortOp, int op, int pos);
+    int RemoveRedundantOut(std::vector<JavaCode> &code);
+    
+    // JavaInline.cpp
+    JavaFunction *FindCallee(JavaCode &code);
+    std::vector<JavaCode> InlineCall(JavaFunction *caller, JavaFunction *callee, int base);
+    
+    // JavaFlow.cpp
+    void RemoveDeadCode(JavaFunction *func);
+    void LayoutCode(JavaFunction *func);
+    bool ComputeFrames(JavaFunction *func);
+    bool SimulateCode(JavaCode &code, int index, JavaFrame &frame);
+    JavaFrame GetInitialFrame(JavaFunction *func);
+    std::string FindClassName(int classPos);
+    void EncodeFrames(JavaFunction *func, std::map<int, JavaFrame> &frames, std::vector<int> &offsets);
+    void EncodeVerifyType(std::vector<unsigned char> &out, JavaVerifyType type, std::vector<int> &offsets);
+
     JavaClassFile *java;
     std::string className;
     int codeIdx = 0;
@@ -72,7 +206,16 @@ private:
     std::map<std::string, int> UTF8Index;
     std::map<std::string, int> classMap;
     std::map<std::string, int> fieldMap;
+    std::map<int, std::string> fieldTypes;
     //std::map<std::string, int> methodMap;
     std::vector<Method> methodMap;
     std::map<std::string, int> constMap;
+    std::map<int, int> intConstMap;
+    std::map<int64_t, int> longConstMap;
+    std::map<std::string, int> concatSites;
+    int concatHandle = 0;
+    
+    int peepholeSaved = 0;
+    std::map<std::string, int> peepholeHits;
+    std::vector<std::string> inlineReport;
 };
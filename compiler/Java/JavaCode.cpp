@@ -11,7 +11,7 @@ JavaFunction *JavaClassBuilder::CreateMethod(std::string name, std::string signa
     int nameIdx = AddUTF8(name);
     int sigIdx = AddUTF8(signature);
 
-    JavaFunction *func = new JavaFunction(flags, nameIdx, sigIdx, codeIdx);
+    JavaFunction *func = new JavaFunction(flags, nameIdx, sigIdx, codeIdx, name, signature);
     java->methods.push_back(func);
 
     // Create a name and type entry
@@ -29,32 +29,73 @@ JavaFunction *JavaClassBuilder::CreateMethod(std::string name, std::string signa
     return func;
 }
 
+// Creates a field in this class
+void JavaClassBuilder::CreateField(std::string name, std::string signature, int flags) {
+    int nameIdx = AddUTF8(name);
+    int sigIdx = AddUTF8(signature);
+    java->fields.push_back(JavaField(flags, nameIdx, sigIdx));
+    
+    JavaNameTypeEntry *nt = new JavaNameTypeEntry(nameIdx, sigIdx);
+    int ntPos = java->AddConst(nt);
+    
+    JavaFieldRefEntry *ref = new JavaFieldRefEntry(superPos, ntPos);
+    int refPos = java->AddConst(ref);
+    
+    fieldMap[name] = refPos;
+    fieldTypes[refPos] = signature;
+}
+
+// Encodes a local variable load or store
+// Slots 0-3 have their own one-byte opcodes; anything past 255 needs the wide prefix
+JavaCode JavaClassBuilder::EncodeLocalOp(int shortOp, int op, int pos) {
+    if (pos <= 3) {
+        return JavaCode((unsigned char)(shortOp + pos));
+    } else if (pos <= 255) {
+        return JavaCode((unsigned char)op, (unsigned char)pos);
+    }
+    
+    return JavaCode((unsigned char)op, (unsigned short)pos, true);
+}
+
+// Encodes an integer constant that doesn't need the constant pool
+// Returns false if the value needs an ldc
+bool JavaClassBuilder::EncodeIConst(int value, JavaCode &code) {
+    if (value >= -1 && value <= 5) {
+        code = JavaCode((unsigned char)(0x03 + value));
+    } else if (value >= -128 && value <= 127) {
+        code = JavaCode(0x10, (unsigned char)value);
+    } else if (value >= -32768 && value <= 32767) {
+        code = JavaCode(0x11, (unsigned short)value);
+    } else {
+        return false;
+    }
+    
+    return true;
+}
+
+// Encodes an iinc, using the wide form if the slot or amount needs it
+// Returns false if the amount doesn't fit in the wide form's 16 bits
+bool JavaClassBuilder::EncodeIInc(int pos, int amount, JavaCode &code) {
+    if (amount < -32768 || amount > 32767) return false;
+
+    bool wide = pos > 255 || amount < -128 || amount > 127;
+    code = JavaCode((unsigned short)pos, (short)amount, wide);
+    return true;
+}
+
+// Creates a local variable load or store
+void JavaClassBuilder::CreateLocalOp(JavaFunction *func, int shortOp, int op, int pos) {
+    func->addCode(EncodeLocalOp(shortOp, op, pos));
+}
+
 // Creates an ALOAD instruction
 void JavaClassBuilder::CreateALoad(JavaFunction *func, int pos) {
-    switch (pos) {
-        case 0: func->addCode(JavaCode(0x2A)); break;
-        case 1: func->addCode(JavaCode(0x2B)); break;
-        case 2: func->addCode(JavaCode(0x2C)); break;
-        case 3: func->addCode(JavaCode(0x2D)); break;
-
-        default: {
-            func->addCode(JavaCode(0x19, (unsigned char)pos));
-        }
-    }
+    CreateLocalOp(func, 0x2A, 0x19, pos);
 }
 
 // Creates an ASTORE instruction
 void JavaClassBuilder::CreateAStore(JavaFunction *func, int pos) {
-    switch (pos) {
-        case 0: func->addCode(JavaCode(0x4B)); break;
-        case 1: func->addCode(JavaCode(0x4C)); break;
-        case 2: func->addCode(JavaCode(0x4D)); break;
-        case 3: func->addCode(JavaCode(0x4E)); break;
-
-        default: {
-            func->addCode(JavaCode(0x3A, (unsigned char)pos));
-        }
-    }
+    CreateLocalOp(func, 0x4B, 0x3A, pos);
 }
 
 // Creates a NEW instruction
@@ -70,6 +111,12 @@ void JavaClassBuilder::CreateDup(JavaFunction *func) {
     func->addCode(JavaCode(0x59));
 }
 
+// Creates a pop (or pop2, for a long) to throw away an unused value
+void JavaClassBuilder::CreatePop(JavaFunction *func, int width) {
+    if (width == 2) func->addCode(JavaCode(0x58));
+    else func->addCode(JavaCode(0x57));
+}
+
 // Creates a getstatic instruction
 void JavaClassBuilder::CreateGetStatic(JavaFunction *func, std::string name) {
     int fieldPos = fieldMap[name];
@@ -78,22 +125,66 @@ void JavaClassBuilder::CreateGetStatic(JavaFunction *func, std::string name) {
     func->addCode(code);
 }
 
+// Creates a putstatic instruction
+void JavaClassBuilder::CreatePutStatic(JavaFunction *func, std::string name) {
+    int fieldPos = fieldMap[name];
+
+    JavaCode code(0xB3, (unsigned short)fieldPos);
+    func->addCode(code);
+}
+
 // Creates a LDC instruction (loads a string specifically)
 void JavaClassBuilder::CreateString(JavaFunction *func, std::string value) {
-    int constPos = 0;
+    CreateLdc(func, AddString(value));
+}
 
-    if (constMap.find(value) == constMap.end()) {
-        constPos = AddUTF8(value);
-        JavaStringEntry *entry = new JavaStringEntry(constPos);
-        constPos = java->AddConst(entry);
+// Loads a string made of any UTF-16 code units
+// The class file stores strings in modified UTF-8: zero takes two bytes, and
+// each half of a surrogate pair is encoded on its own, so any sequence of
+// 16-bit values survives. One constant can't go over 65535 bytes, so a longer
+// string is split up and put back together with String.concat.
+void JavaClassBuilder::CreatePackedString(JavaFunction *func, std::vector<uint16_t> chars) {
+    std::vector<std::string> chunks = { "" };
+    
+    for (uint16_t c : chars) {
+        std::string bytes = "";
+        if (c >= 0x01 && c <= 0x7F) {
+            bytes += (char)c;
+        } else if (c <= 0x7FF) {
+            bytes += (char)(0xC0 | (c >> 6));
+            bytes += (char)(0x80 | (c & 0x3F));
+        } else {
+            bytes += (char)(0xE0 | (c >> 12));
+            bytes += (char)(0x80 | ((c >> 6) & 0x3F));
+            bytes += (char)(0x80 | (c & 0x3F));
+        }
+        
+        if (chunks.back().size() + bytes.size() > 65535) chunks.push_back("");
+        chunks.back() += bytes;
+    }
+    
+    CreateString(func, chunks[0]);
+    if (chunks.size() == 1) return;
+    
+    std::string signature = "(Ljava/lang/String;)Ljava/lang/String;";
+    if (FindMethod("concat", "java/lang/String", signature) == 0) {
+        ImportMethod("java/lang/String", "concat", signature);
+    }
+    
+    for (int i = 1; i<chunks.size(); i++) {
+        CreateString(func, chunks[i]);
+        CreateInvokeVirtual(func, "concat", "java/lang/String", signature);
+    }
+}
 
-        constMap[value] = constPos;
+// Creates a LDC instruction for a single-slot constant
+// Anything past index 255 won't fit in the byte operand, so use ldc_w
+void JavaClassBuilder::CreateLdc(JavaFunction *func, int pos) {
+    if (pos <= 255) {
+        func->addCode(JavaCode(0x12, (unsigned char)pos));
     } else {
-        constPos = constMap[value];
+        func->addCode(JavaCode(0x13, (unsigned short)pos));
     }
-
-    JavaCode code(0x12, (unsigned char)constPos);
-    func->addCode(code);
 }
 
 // Creates an InvokeSpecial instruction
@@ -120,43 +211,99 @@ void JavaClassBuilder::CreateInvokeStatic(JavaFunction *func, std::string name,
     func->addCode(code);
 }
 
+// Creates a string concatenation with invokedynamic
+// StringConcatFactory builds the call site from the recipe: each \1 is the
+// next argument, and everything else is copied as is. Call sites with the
+// same recipe and types share their constant pool entries.
+void JavaClassBuilder::CreateConcat(JavaFunction *func, std::string recipe, std::string signature) {
+    std::string key = recipe + signature;
+    
+    if (concatSites.find(key) == concatSites.end()) {
+        std::string factory = "java/lang/invoke/StringConcatFactory";
+        std::string bootstrapSig = "(Ljava/lang/invoke/MethodHandles$Lookup;Ljava/lang/String;"
+            "Ljava/lang/invoke/MethodType;Ljava/lang/String;[Ljava/lang/Object;)Ljava/lang/invoke/CallSite;";
+        
+        // Every call site uses the same bootstrap method
+        if (concatHandle == 0) {
+            ImportMethod(factory, "makeConcatWithConstants", bootstrapSig);
+            int methodPos = FindMethod("makeConcatWithConstants", factory, bootstrapSig);
+            concatHandle = java->AddConst(new JavaMethodHandleEntry(6, methodPos));
+        }
+        
+        JavaBootstrapMethod bootstrap;
+        bootstrap.methodHandle = concatHandle;
+        bootstrap.args.push_back(AddString(recipe));
+        java->bootstrapMethods.push_back(bootstrap);
+        
+        int namePos = AddUTF8("makeConcatWithConstants");
+        int sigPos = AddUTF8(signature);
+        int ntPos = java->AddConst(new JavaNameTypeEntry(namePos, sigPos));
+        int pos = java->AddConst(new JavaInvokeDynamicEntry(java->bootstrapMethods.size() - 1, ntPos));
+        
+        // The call site goes in the method table so the stack can be worked out
+        Method m("makeConcatWithConstants", pos, "", signature);
+        methodMap.push_back(m);
+        concatSites[key] = pos;
+    }
+    
+    func->addCode(JavaCode::InvokeDynamic(concatSites[key]));
+}
+
 // Creates a return-void call
 void JavaClassBuilder::CreateRetVoid(JavaFunction *func) {
     func->addCode(JavaCode(0xB1));
 }
 
-// Creates a bipush call
-void JavaClassBuilder::CreateBIPush(JavaFunction *func, int value) {
-    JavaCode code(0x10, (unsigned char)value);
-    func->addCode(code);
+// Creates an ireturn instruction
+void JavaClassBuilder::CreateIRet(JavaFunction *func) {
+    func->addCode(JavaCode(0xAC));
+}
+
+// Creates an lreturn instruction
+void JavaClassBuilder::CreateLRet(JavaFunction *func) {
+    func->addCode(JavaCode(0xAD));
+}
+
+// Creates an areturn instruction
+void JavaClassBuilder::CreateARet(JavaFunction *func) {
+    func->addCode(JavaCode(0xB0));
+}
+
+// Loads an integer constant using the shortest encoding
+// iconst_m1..iconst_5 -> bipush -> sipush -> ldc/ldc_w of a pooled Integer
+void JavaClassBuilder::CreateIConst(JavaFunction *func, int value) {
+    JavaCode code(0x00);
+    if (EncodeIConst(value, code)) {
+        func->addCode(code);
+    } else {
+        int pos = AddInteger(value);
+        CreateLdc(func, pos);
+    }
 }
 
 // Creates an i_load call
 void JavaClassBuilder::CreateILoad(JavaFunction *func, int value) {
-    switch (value) {
-        case 0: func->addCode(JavaCode(0x1A)); break;
-        case 1: func->addCode(JavaCode(0x1B)); break;
-        case 2: func->addCode(JavaCode(0x1C)); break;
-        case 3: func->addCode(JavaCode(0x1D)); break;
-
-        default: {
-            func->addCode(JavaCode(0x15, (unsigned char)value));
-        }
-    }
+    CreateLocalOp(func, 0x1A, 0x15, value);
 }
 
 // Creates an i_store call
 void JavaClassBuilder::CreateIStore(JavaFunction *func, int value) {
-    switch (value) {
-        case 0: func->addCode(JavaCode(0x3B)); break;
-        case 1: func->addCode(JavaCode(0x3C)); break;
-        case 2: func->addCode(JavaCode(0x3D)); break;
-        case 3: func->addCode(JavaCode(0x3E)); break;
-
-        default: {
-            func->addCode(JavaCode(0x36, (unsigned char)value));
-        }
+    CreateLocalOp(func, 0x3B, 0x36, value);
+}
+
+// Creates an iinc instruction
+// An amount too big for an iinc is added the long way
+void JavaClassBuilder::CreateIInc(JavaFunction *func, int pos, int amount) {
+    JavaCode code(0x84);
+    if (EncodeIInc(pos, amount, code)) {
+        func->addCode(code);
+        return;
     }
+
+    CreateILoad(func, pos);
+    CreateIConst(func, amount);
+    CreateIAdd(func);
+    CreateIStore(func, pos);
 }
 
 // Creates an i_add instruction
@@ -208,3 +355,257 @@ void JavaClassBuilder::CreateIShl(JavaFunction *func) {
 void JavaClassBuilder::CreateIShr(JavaFunction *func) {
     func->addCode(JavaCode(0x7A));
 }
+
+// Creates an i_ushr instruction
+void JavaClassBuilder::CreateIUShr(JavaFunction *func) {
+    func->addCode(JavaCode(0x7C));
+}
+
+// Creates an i_neg instruction
+void JavaClassBuilder::CreateINeg(JavaFunction *func) {
+    func->addCode(JavaCode(0x74));
+}
+
+// Creates an i2b instruction
+void JavaClassBuilder::CreateI2B(JavaFunction *func) {
+    func->addCode(JavaCode(0x91));
+}
+
+// Creates an i2c instruction
+void JavaClassBuilder::CreateI2C(JavaFunction *func) {
+    func->addCode(JavaCode(0x92));
+}
+
+// Creates an i2s instruction
+void JavaClassBuilder::CreateI2S(JavaFunction *func) {
+    func->addCode(JavaCode(0x93));
+}
+
+// Loads a long constant
+// lconst_0/lconst_1 are one byte. Other values that fit in a byte are loaded as an
+// int and widened, which is no longer than ldc2_w and saves a pool entry
+void JavaClassBuilder::CreateLConst(JavaFunction *func, int64_t value) {
+    if (value == 0 || value == 1) {
+        func->addCode(JavaCode((unsigned char)(0x09 + value)));
+    } else if (value >= -128 && value <= 127) {
+        CreateIConst(func, (int)value);
+        CreateI2L(func);
+    } else {
+        int pos = AddLong(value);
+        func->addCode(JavaCode(0x14, (unsigned short)pos));
+    }
+}
+
+// Creates an i2l instruction
+void JavaClassBuilder::CreateI2L(JavaFunction *func) {
+    func->addCode(JavaCode(0x85));
+}
+
+// Creates an l2i instruction
+void JavaClassBuilder::CreateL2I(JavaFunction *func) {
+    func->addCode(JavaCode(0x88));
+}
+
+// Creates an l_add instruction
+void JavaClassBuilder::CreateLAdd(JavaFunction *func) {
+    func->addCode(JavaCode(0x61));
+}
+
+// Creates an l_sub instruction
+void JavaClassBuilder::CreateLSub(JavaFunction *func) {
+    func->addCode(JavaCode(0x65));
+}
+
+// Creates an l_mul instruction
+void JavaClassBuilder::CreateLMul(JavaFunction *func) {
+    func->addCode(JavaCode(0x69));
+}
+
+// Creates an l_div instruction
+void JavaClassBuilder::CreateLDiv(JavaFunction *func) {
+    func->addCode(JavaCode(0x6D));
+}
+
+// Creates an l_rem instruction
+void JavaClassBuilder::CreateLRem(JavaFunction *func) {
+    func->addCode(JavaCode(0x71));
+}
+
+// Creates an l_and instruction
+void JavaClassBuilder::CreateLAnd(JavaFunction *func) {
+    func->addCode(JavaCode(0x7F));
+}
+
+// Creates an l_or instruction
+void JavaClassBuilder::CreateLOr(JavaFunction *func) {
+    func->addCode(JavaCode(0x81));
+}
+
+// Creates an l_xor instruction
+void JavaClassBuilder::CreateLXor(JavaFunction *func) {
+    func->addCode(JavaCode(0x83));
+}
+
+// Creates an l_shl instruction
+void JavaClassBuilder::CreateLShl(JavaFunction *func) {
+    func->addCode(JavaCode(0x79));
+}
+
+// Creates an l_shr instruction
+void JavaClassBuilder::CreateLShr(JavaFunction *func) {
+    func->addCode(JavaCode(0x7B));
+}
+
+// Creates an l_ushr instruction
+void JavaClassBuilder::CreateLUShr(JavaFunction *func) {
+    func->addCode(JavaCode(0x7D));
+}
+
+// Creates an l_neg instruction
+void JavaClassBuilder::CreateLNeg(JavaFunction *func) {
+    func->addCode(JavaCode(0x75));
+}
+
+// Creates an lcmp instruction
+void JavaClassBuilder::CreateLCmp(JavaFunction *func) {
+    func->addCode(JavaCode(0x94));
+}
+
+// Creates an l_load call
+void JavaClassBuilder::CreateLLoad(JavaFunction *func, int pos) {
+    CreateLocalOp(func, 0x1E, 0x16, pos);
+}
+
+// Creates an l_store call
+void JavaClassBuilder::CreateLStore(JavaFunction *func, int pos) {
+    CreateLocalOp(func, 0x3F, 0x37, pos);
+}
+
+// Creates a newarray instruction (arrays of primitives)
+void JavaClassBuilder::CreateNewArray(JavaFunction *func, JavaArrayType type) {
+    func->addCode(JavaCode(0xBC, (unsigned char)type));
+}
+
+// Creates an anewarray instruction (arrays of objects)
+void JavaClassBuilder::CreateANewArray(JavaFunction *func, std::string className) {
+    int pos = ImportClass(className);
+    func->addCode(JavaCode(0xBD, (unsigned short)pos));
+}
+
+// Creates an arraylength instruction
+void JavaClassBuilder::CreateArrayLength(JavaFunction *func) {
+    func->addCode(JavaCode(0xBE));
+}
+
+// Creates an iaload instruction
+void JavaClassBuilder::CreateIALoad(JavaFunction *func) {
+    func->addCode(JavaCode(0x2E));
+}
+
+// Creates a laload instruction
+void JavaClassBuilder::CreateLALoad(JavaFunction *func) {
+    func->addCode(JavaCode(0x2F));
+}
+
+// Creates an aaload instruction
+void JavaClassBuilder::CreateAALoad(JavaFunction *func) {
+    func->addCode(JavaCode(0x32));
+}
+
+// Creates a baload instruction (bytes and booleans)
+void JavaClassBuilder::CreateBALoad(JavaFunction *func) {
+    func->addCode(JavaCode(0x33));
+}
+
+// Creates a caload instruction
+void JavaClassBuilder::CreateCALoad(JavaFunction *func) {
+    func->addCode(JavaCode(0x34));
+}
+
+// Creates a saload instruction
+void JavaClassBuilder::CreateSALoad(JavaFunction *func) {
+    func->addCode(JavaCode(0x35));
+}
+
+// Creates an iastore instruction
+void JavaClassBuilder::CreateIAStore(JavaFunction *func) {
+    func->addCode(JavaCode(0x4F));
+}
+
+// Creates a lastore instruction
+void JavaClassBuilder::CreateLAStore(JavaFunction *func) {
+    func->addCode(JavaCode(0x50));
+}
+
+// Creates an aastore instruction
+void JavaClassBuilder::CreateAAStore(JavaFunction *func) {
+    func->addCode(JavaCode(0x53));
+}
+
+// Creates a bastore instruction (bytes and booleans)
+void JavaClassBuilder::CreateBAStore(JavaFunction *func) {
+    func->addCode(JavaCode(0x54));
+}
+
+// Creates a castore instruction
+void JavaClassBuilder::CreateCAStore(JavaFunction *func) {
+    func->addCode(JavaCode(0x55));
+}
+
+// Creates a sastore instruction
+void JavaClassBuilder::CreateSAStore(JavaFunction *func) {
+    func->addCode(JavaCode(0x56));
+}
+
+// Creates a new label
+// The label doesn't go anywhere until it is set
+int JavaClassBuilder::CreateLabel(JavaFunction *func) {
+    return func->newLabel();
+}
+
+// Places a label at the current position
+void JavaClassBuilder::SetLabel(JavaFunction *func, int label) {
+    func->addCode(JavaCode::Label(label));
+}
+
+// Creates a branch to a label
+// The offset is filled in when the method is laid out
+void JavaClassBuilder::CreateBranch(JavaFunction *func, JavaBranch branch, int label) {
+    func->addCode(JavaCode::Branch(branch, label));
+}
+
+// Creates a goto instruction
+void JavaClassBuilder::CreateGoto(JavaFunction *func, int label) {
+    CreateBranch(func, B_GOTO, label);
+}
+
+// Creates a switch on the int at the top of the stack
+// The cases map each key to a label. Like javac, we use a tableswitch if the
+// keys are dense enough that the jump table isn't much bigger than the
+// key/offset pairs of a lookupswitch.
+void JavaClassBuilder::CreateSwitch(JavaFunction *func, std::map<int, int> cases, int defaultLabel) {
+    int64_t low = cases.begin()->first;
+    int64_t high = cases.rbegin()->first;
+    int64_t count = cases.size();
+
+    int64_t tableCost = (4 + (high - low + 1)) + 3 * 3;
+    int64_t lookupCost = (3 + 2 * count) + 3 * count;
+
+    std::vector<int> keys;
+    std::vector<int> labels;
+
+    if (tableCost <= lookupCost) {
+        keys.push_back((int)low);
+        for (int64_t key = low; key <= high; key++) {
+            auto entry = cases.find((int)key);
+            labels.push_back(entry == cases.end() ? defaultLabel : entry->second);
+        }
+        func->addCode(JavaCode::Switch(0xAA, defaultLabel, keys, labels));
+    } else {
+        for (auto entry : cases) {
+            keys.push_back(entry.first);
+            labels.push_back(entry.second);
+        }
+        func->addCode(JavaCode::Switch(0xAB, defaultLabel, keys, labels));
+    }
+}
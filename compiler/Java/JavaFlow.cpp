@@ -0,0 +1,642 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// JavaFlow.cpp
+// Everything that needs to know about control flow: dead code removal, branch
+// layout, and the StackMapTable frames the verifier needs for class version 50+
+#include <vector>
+#include <map>
+
+#include <Java/JavaBuilder.hpp>
+#include <Java/JavaIR.hpp>
+
+//
+// Helpers
+//
+
+// Returns the position of each label in the code
+static std::map<int, int> FindLabels(std::vector<JavaCode> &code) {
+    std::map<int, int> labels;
+    for (int i = 0; i<code.size(); i++) {
+        if (code[i].isLabel()) labels[code[i].label] = i;
+    }
+    return labels;
+}
+
+// Returns the labels an instruction can jump to
+static std::vector<int> GetTargets(JavaCode &code) {
+    std::vector<int> targets;
+    if (code.isBranch()) {
+        targets.push_back(code.label);
+    } else if (code.isSwitch()) {
+        targets = code.labels;
+        targets.push_back(code.label);
+    }
+    return targets;
+}
+
+// Returns true if control never falls through to the next instruction
+static bool IsUnconditional(JavaCode &code) {
+    if (code.isBranch()) return code.opcode == B_GOTO;
+    if (code.isSwitch()) return true;
+    if (code.argPos != 0) return false;
+
+    int op = code.opcode;
+    return (op >= 0xAC && op <= 0xB1) || op == 0xBF;     // *return, athrow
+}
+
+// Returns the verification type for a field descriptor
+static JavaVerifyType GetDescType(std::string desc) {
+    switch (desc[0]) {
+        case 'Z':
+        case 'B':
+        case 'C':
+        case 'S':
+        case 'I': return JavaVerifyType(V_INTEGER);
+        case 'J': return JavaVerifyType(V_LONG);
+        case 'F': return JavaVerifyType(V_FLOAT);
+        case 'D': return JavaVerifyType(V_DOUBLE);
+        case 'L': return JavaVerifyType(V_OBJECT, desc.substr(1, desc.length() - 2));
+        case '[': return JavaVerifyType(V_OBJECT, desc);
+
+        default: {}
+    }
+
+    return JavaVerifyType(V_TOP);
+}
+
+static bool IsWide(JavaVerifyType type) {
+    return type.tag == V_LONG || type.tag == V_DOUBLE;
+}
+
+// Splits a method descriptor into its argument types and return type
+static void ParseSignature(std::string signature, std::vector<JavaVerifyType> &args, std::string &ret) {
+    int i = 1;
+    while (signature[i] != ')') {
+        int start = i;
+        while (signature[i] == '[') ++i;
+        if (signature[i] == 'L') i = signature.find(';', i);
+
+        args.push_back(GetDescType(signature.substr(start, i - start + 1)));
+        ++i;
+    }
+
+    ret = signature.substr(i + 1);
+}
+
+static void Push(JavaFrame &frame, JavaVerifyType type) {
+    frame.stack.push_back(type);
+    if (IsWide(type)) frame.stack.push_back(JavaVerifyType(V_TOP));
+}
+
+static void Pop(JavaFrame &frame, int slots) {
+    for (int i = 0; i<slots && !frame.stack.empty(); i++) frame.stack.pop_back();
+}
+
+static void SetLocal(JavaFrame &frame, int slot, JavaVerifyType type) {
+    int width = IsWide(type) ? 2 : 1;
+    if (slot + width > frame.locals.size()) frame.locals.resize(slot + width);
+
+    // Writing the second half of a long kills the long
+    if (slot > 0 && IsWide(frame.locals[slot - 1])) frame.locals[slot - 1] = JavaVerifyType(V_TOP);
+
+    frame.locals[slot] = type;
+    if (width == 2) frame.locals[slot + 1] = JavaVerifyType(V_TOP);
+}
+
+// Returns the slot used by a local variable instruction
+static int GetLocalSlot(JavaCode &code, JavaLocalOp kind) {
+    int slot = 0;
+    code.isLocalOp(kind, slot);
+    return slot;
+}
+
+// Returns the type both paths agree on when control flow joins
+static JavaVerifyType MergeType(JavaVerifyType a, JavaVerifyType b) {
+    if (a == b) return a;
+
+    bool aRef = a.tag == V_OBJECT || a.tag == V_NULL;
+    bool bRef = b.tag == V_OBJECT || b.tag == V_NULL;
+    if (aRef && bRef) {
+        if (a.tag == V_NULL) return b;
+        if (b.tag == V_NULL) return a;
+        return JavaVerifyType(V_OBJECT, "java/lang/Object");
+    }
+
+    return JavaVerifyType(V_TOP);
+}
+
+// Merges a frame into another
+// Returns true if the destination changed
+static bool MergeFrame(JavaFrame &dest, JavaFrame &src) {
+    bool changed = false;
+
+    for (int i = 0; i<dest.locals.size() && i<src.locals.size(); i++) {
+        JavaVerifyType type = MergeType(dest.locals[i], src.locals[i]);
+        if (type != dest.locals[i]) {
+            dest.locals[i] = type;
+            changed = true;
+        }
+    }
+
+    for (int i = 0; i<dest.stack.size() && i<src.stack.size(); i++) {
+        JavaVerifyType type = MergeType(dest.stack[i], src.stack[i]);
+        if (type != dest.stack[i]) {
+            dest.stack[i] = type;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+// Drops the implicit second half of longs, and optionally any trailing tops
+static std::vector<JavaVerifyType> CompressTypes(std::vector<JavaVerifyType> types, bool trim) {
+    std::vector<JavaVerifyType> out;
+    for (int i = 0; i<types.size(); i++) {
+        out.push_back(types[i]);
+        if (IsWide(types[i])) ++i;
+    }
+
+    if (trim) {
+        while (!out.empty() && out.back().tag == V_TOP) out.pop_back();
+    }
+
+    return out;
+}
+
+//
+// Dead code
+//
+
+// Removes anything control can't reach, then any goto to the next instruction
+// The verifier wants a frame for code after an unconditional branch even if
+// nothing jumps there, so it's easier to not have any
+void JavaClassBuilder::RemoveDeadCode(JavaFunction *func) {
+    std::vector<JavaCode> &code = func->getCodeBlock()->code;
+    std::map<int, int> labels = FindLabels(code);
+
+    std::vector<bool> reachable(code.size(), false);
+    std::vector<int> worklist;
+    worklist.push_back(0);
+
+    while (!worklist.empty()) {
+        int i = worklist.back();
+        worklist.pop_back();
+        if (i >= code.size() || reachable[i]) continue;
+
+        reachable[i] = true;
+        for (int target : GetTargets(code[i])) worklist.push_back(labels[target]);
+        if (!IsUnconditional(code[i])) worklist.push_back(i + 1);
+    }
+
+    std::vector<JavaCode> live;
+    for (int i = 0; i<code.size(); i++) {
+        if (reachable[i] || code[i].isLabel()) live.push_back(code[i]);
+    }
+
+    code.clear();
+    for (int i = 0; i<live.size(); i++) {
+        if (live[i].isBranch() && live[i].opcode == B_GOTO) {
+            bool toNext = false;
+            for (int j = i + 1; j<live.size() && live[j].isLabel(); j++) {
+                if (live[j].label == live[i].label) toNext = true;
+            }
+            if (toNext) continue;
+        }
+
+        code.push_back(live[i]);
+    }
+}
+
+//
+// Layout
+//
+
+// Works out the branch offsets
+// Everything starts out as a short branch; anything that doesn't reach gets
+// turned into goto_w (or a flipped branch over a goto_w). That can push other
+// branches out of range, so we go until nothing changes. Branches only ever
+// grow, so this always stops. Switch padding only depends on where the switch
+// starts, so it's worked out as we go.
+void JavaClassBuilder::LayoutCode(JavaFunction *func) {
+    std::vector<JavaCode> &code = func->getCodeBlock()->code;
+    std::vector<int> offsets(code.size(), 0);
+    std::map<int, int> labelOffsets;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        int pos = 0;
+        for (int i = 0; i<code.size(); i++) {
+            offsets[i] = pos;
+            if (code[i].isLabel()) labelOffsets[code[i].label] = pos;
+            if (code[i].isSwitch()) code[i].pad = 3 - (pos % 4);
+            pos += code[i].size();
+        }
+
+        for (int i = 0; i<code.size(); i++) {
+            if (!code[i].isBranch() || code[i].far) continue;
+
+            int jump = labelOffsets[code[i].label] - offsets[i];
+            if (jump < -32768 || jump > 32767) {
+                code[i].far = true;
+                changed = true;
+            }
+        }
+    }
+
+    for (int i = 0; i<code.size(); i++) {
+        if (code[i].isBranch() || code[i].isSwitch()) code[i].jump = labelOffsets[code[i].label] - offsets[i];
+
+        if (code[i].isSwitch()) {
+            code[i].jumps.clear();
+            for (int label : code[i].labels) code[i].jumps.push_back(labelOffsets[label] - offsets[i]);
+        }
+    }
+}
+
+//
+// Frames
+//
+
+// Returns the name of a class from its constant pool index
+std::string JavaClassBuilder::FindClassName(int classPos) {
+    for (auto entry : classMap) {
+        if (entry.second == classPos) return entry.first;
+    }
+    return "java/lang/Object";
+}
+
+// Returns the frame on entry to a method, built from its descriptor
+JavaFrame JavaClassBuilder::GetInitialFrame(JavaFunction *func) {
+    JavaFrame frame;
+
+    if (!func->isStatic()) {
+        if (func->getName() == "<init>") frame.locals.push_back(JavaVerifyType(V_UNINIT_THIS));
+        else frame.locals.push_back(JavaVerifyType(V_OBJECT, className));
+    }
+
+    std::vector<JavaVerifyType> args;
+    std::string ret = "";
+    ParseSignature(func->getSignature(), args, ret);
+
+    for (JavaVerifyType arg : args) {
+        frame.locals.push_back(arg);
+        if (IsWide(arg)) frame.locals.push_back(JavaVerifyType(V_TOP));
+    }
+
+    if (frame.locals.size() < func->getMaxLocals()) frame.locals.resize(func->getMaxLocals());
+    return frame;
+}
+
+// Applies one instruction to a frame
+// Returns false if we don't know the instruction
+bool JavaClassBuilder::SimulateCode(JavaCode &code, int index, JavaFrame &frame) {
+    if (code.isLabel()) return true;
+
+    int op = code.opcode;
+    JavaVerifyType INT(V_INTEGER);
+    JavaVerifyType LONG(V_LONG);
+
+    if (code.isBranch()) {
+        if (op == B_GOTO) {}
+        else if (op >= B_IF_ICMPEQ && op <= B_IF_ACMPNE) Pop(frame, 2);
+        else Pop(frame, 1);
+        return true;
+    } else if (code.isSwitch()) {
+        Pop(frame, 1);
+        return true;
+    }
+
+    // Constants
+    if (op == 0x00) {}                                                  // nop
+    else if (op == 0x01) Push(frame, JavaVerifyType(V_NULL));           // aconst_null
+    else if (op >= 0x02 && op <= 0x08) Push(frame, INT);                // iconst
+    else if (op == 0x09 || op == 0x0A) Push(frame, LONG);               // lconst
+    else if (op == 0x10 || op == 0x11) Push(frame, INT);                // bipush, sipush
+    else if (op == 0x12 || op == 0x13) {                                // ldc, ldc_w
+        int pos = op == 0x12 ? code.arg1_byte : code.arg1;
+        int tag = java->const_pool[pos - 1]->tag;
+        if (tag == INTEGER) Push(frame, INT);
+        else if (tag == STRING) Push(frame, JavaVerifyType(V_OBJECT, "java/lang/String"));
+        else return false;
+    }
+    else if (op == 0x14) Push(frame, LONG);                             // ldc2_w
+
+    // Locals
+    else if (op == 0x15 || (op >= 0x1A && op <= 0x1D)) Push(frame, INT);        // iload
+    else if (op == 0x16 || (op >= 0x1E && op <= 0x21)) Push(frame, LONG);       // lload
+    else if (op == 0x19 || (op >= 0x2A && op <= 0x2D)) {                        // aload
+        int slot = GetLocalSlot(code, L_ALOAD);
+        if (slot < frame.locals.size()) Push(frame, frame.locals[slot]);
+        else Push(frame, JavaVerifyType(V_TOP));
+    }
+    else if (op == 0x36 || (op >= 0x3B && op <= 0x3E)) {                        // istore
+        Pop(frame, 1);
+        SetLocal(frame, GetLocalSlot(code, L_ISTORE), INT);
+    }
+    else if (op == 0x37 || (op >= 0x3F && op <= 0x42)) {                        // lstore
+        Pop(frame, 2);
+        SetLocal(frame, GetLocalSlot(code, L_LSTORE), LONG);
+    }
+    else if (op == 0x3A || (op >= 0x4B && op <= 0x4E)) {                        // astore
+        JavaVerifyType type = frame.stack.back();
+        Pop(frame, 1);
+        SetLocal(frame, GetLocalSlot(code, L_ASTORE), type);
+    }
+    else if (op == 0x84) {}                                                     // iinc
+
+    // Arrays
+    else if (op == 0x2E || (op >= 0x33 && op <= 0x35)) { Pop(frame, 2); Push(frame, INT); }    // i/b/c/saload
+    else if (op == 0x2F) { Pop(frame, 2); Push(frame, LONG); }                  // laload
+    else if (op == 0x32) {                                                      // aaload
+        JavaVerifyType array = frame.stack[frame.stack.size() - 2];
+        Pop(frame, 2);
+        if (array.tag == V_OBJECT && array.className[0] == '[') Push(frame, GetDescType(array.className.substr(1)));
+        else Push(frame, JavaVerifyType(V_NULL));
+    }
+    else if (op == 0x4F || (op >= 0x53 && op <= 0x56)) Pop(frame, 3);          // *astore
+    else if (op == 0x50) Pop(frame, 4);                                         // lastore
+    else if (op == 0xBC) {                                                      // newarray
+        const std::string types[] = { "[Z", "[C", "[F", "[D", "[B", "[S", "[I", "[J" };
+        Pop(frame, 1);
+        Push(frame, JavaVerifyType(V_OBJECT, types[code.arg1_byte - 4]));
+    }
+    else if (op == 0xBD) {                                                      // anewarray
+        std::string name = FindClassName(code.arg1);
+        if (name[0] != '[') name = "L" + name + ";";
+        Pop(frame, 1);
+        Push(frame, JavaVerifyType(V_OBJECT, "[" + name));
+    }
+    else if (op == 0xBE) { Pop(frame, 1); Push(frame, INT); }                   // arraylength
+
+    // Stack
+    else if (op == 0x57) Pop(frame, 1);                                         // pop
+    else if (op == 0x58) Pop(frame, 2);                                         // pop2
+    else if (op == 0x59) frame.stack.push_back(frame.stack.back());             // dup
+    else if (op == 0x5A) {                                                      // dup_x1
+        JavaVerifyType v1 = frame.stack.back();
+        frame.stack.insert(frame.stack.end() - 2, v1);
+    }
+    else if (op == 0x5B) {                                                      // dup_x2
+        JavaVerifyType v1 = frame.stack.back();
+        frame.stack.insert(frame.stack.end() - 3, v1);
+    }
+    else if (op == 0x5C) {                                                      // dup2
+        int size = frame.stack.size();
+        frame.stack.push_back(frame.stack[size - 2]);
+        frame.stack.push_back(frame.stack[size - 1]);
+    }
+    else if (op == 0x5F) {                                                      // swap
+        int size = frame.stack.size();
+        std::swap(frame.stack[size - 1], frame.stack[size - 2]);
+    }
+
+    // Math
+    else if (op >= 0x60 && op <= 0x73) {
+        if ((op - 0x60) % 4 == 0) { Pop(frame, 2); Push(frame, INT); }
+        else if ((op - 0x60) % 4 == 1) { Pop(frame, 4); Push(frame, LONG); }
+        else return false;
+    }
+    else if (op == 0x74) {}                                                     // ineg
+    else if (op == 0x75) {}                                                     // lneg
+    else if (op == 0x78 || op == 0x7A || op == 0x7C) { Pop(frame, 2); Push(frame, INT); }     // int shifts
+    else if (op == 0x79 || op == 0x7B || op == 0x7D) { Pop(frame, 3); Push(frame, LONG); }    // long shifts
+    else if (op == 0x7E || op == 0x80 || op == 0x82) { Pop(frame, 2); Push(frame, INT); }     // iand, ior, ixor
+    else if (op == 0x7F || op == 0x81 || op == 0x83) { Pop(frame, 4); Push(frame, LONG); }    // land, lor, lxor
+    else if (op == 0x85) { Pop(frame, 1); Push(frame, LONG); }                  // i2l
+    else if (op == 0x88) { Pop(frame, 2); Push(frame, INT); }                   // l2i
+    else if (op >= 0x91 && op <= 0x93) {}                                       // i2b, i2c, i2s
+    else if (op == 0x94) { Pop(frame, 4); Push(frame, INT); }                   // lcmp
+
+    // Returns
+    else if (op == 0xAC || op == 0xB0) Pop(frame, 1);                           // ireturn, areturn
+    else if (op == 0xAD) Pop(frame, 2);                                         // lreturn
+    else if (op == 0xB1) {}                                                     // return
+    else if (op == 0xBF) Pop(frame, 1);                                         // athrow
+
+    // Fields
+    else if (op == 0xB2) Push(frame, GetDescType(fieldTypes[code.arg1]));       // getstatic
+    else if (op == 0xB3) Pop(frame, IsWide(GetDescType(fieldTypes[code.arg1])) ? 2 : 1);  // putstatic
+
+    // Calls
+    else if ((op >= 0xB6 && op <= 0xB8) || op == 0xBA) {
+        Method *method = nullptr;
+        for (int i = 0; i<methodMap.size(); i++) {
+            if (methodMap[i].pos == code.arg1) {
+                method = &methodMap[i];
+                break;
+            }
+        }
+        if (method == nullptr) return false;
+
+        std::vector<JavaVerifyType> args;
+        std::string ret = "";
+        ParseSignature(method->signature, args, ret);
+
+        for (JavaVerifyType arg : args) Pop(frame, IsWide(arg) ? 2 : 1);
+
+        if (op != 0xB8 && op != 0xBA) {
+            JavaVerifyType receiver = frame.stack.back();
+            Pop(frame, 1);
+
+            // A constructor call initializes every copy of the object
+            if (op == 0xB7 && method->name == "<init>") {
+                JavaVerifyType init(V_OBJECT, receiver.className);
+                if (receiver.tag == V_UNINIT_THIS) init.className = className;
+
+                if (receiver.tag == V_UNINIT_THIS || receiver.tag == V_UNINIT) {
+                    for (JavaVerifyType &type : frame.locals) {
+                        if (type == receiver) type = init;
+                    }
+                    for (JavaVerifyType &type : frame.stack) {
+                        if (type == receiver) type = init;
+                    }
+                }
+            }
+        }
+
+        if (ret != "V") Push(frame, GetDescType(ret));
+    }
+
+    // Objects
+    else if (op == 0xBB) {                                                      // new
+        JavaVerifyType type(V_UNINIT, FindClassName(code.arg1));
+        type.newPos = index;
+        Push(frame, type);
+    }
+    else if (op == 0xC0) {                                                      // checkcast
+        Pop(frame, 1);
+        Push(frame, JavaVerifyType(V_OBJECT, FindClassName(code.arg1)));
+    }
+
+    else return false;
+
+    return true;
+}
+
+// Runs the type dataflow over a method
+// This gives us both the max stack depth and the frame at each branch target.
+// Frames are merged where control flow joins, and we go until they stop changing.
+// An instruction we can't simulate is a compiler bug: without frames the method
+// won't verify, so this fails rather than writing out a broken class.
+bool JavaClassBuilder::ComputeFrames(JavaFunction *func) {
+    std::vector<JavaCode> &code = func->getCodeBlock()->code;
+    if (code.size() == 0) return true;
+
+    std::map<int, int> labels = FindLabels(code);
+    std::vector<JavaFrame> states(code.size());
+    std::vector<bool> visited(code.size(), false);
+
+    states[0] = GetInitialFrame(func);
+    visited[0] = true;
+
+    std::vector<int> worklist;
+    worklist.push_back(0);
+
+    int maxStack = 0;
+
+    auto merge = [&](int target, JavaFrame &frame) {
+        if (target >= code.size()) return;
+
+        if (!visited[target]) {
+            states[target] = frame;
+            visited[target] = true;
+            worklist.push_back(target);
+        } else if (MergeFrame(states[target], frame)) {
+            worklist.push_back(target);
+        }
+    };
+
+    while (!worklist.empty()) {
+        int i = worklist.back();
+        worklist.pop_back();
+
+        JavaFrame frame = states[i];
+        if (!SimulateCode(code[i], i, frame)) {
+            std::cerr << "Internal Error: Unable to compute frames for " << func->getName();
+            std::cerr << " (opcode 0x" << std::hex << (int)code[i].opcode << std::dec << ")" << std::endl;
+            return false;
+        }
+
+        if (frame.stack.size() > maxStack) maxStack = frame.stack.size();
+
+        for (int target : GetTargets(code[i])) merge(labels[target], frame);
+        if (!IsUnconditional(code[i])) merge(i + 1, frame);
+    }
+
+    func->setMaxStack(maxStack);
+
+    // We only need frames where something jumps to
+    std::vector<int> offsets(code.size(), 0);
+    int pos = 0;
+    for (int i = 0; i<code.size(); i++) {
+        offsets[i] = pos;
+        pos += code[i].size();
+    }
+
+    std::map<int, JavaFrame> frames;
+    for (int i = 0; i<code.size(); i++) {
+        for (int label : GetTargets(code[i])) {
+            int target = labels[label];
+            frames[offsets[target]] = states[target];
+        }
+
+        // A far conditional branch jumps over its goto_w to the next instruction
+        if (code[i].isBranch() && code[i].far && code[i].opcode != B_GOTO && i + 1 < code.size()) {
+            frames[offsets[i + 1]] = states[i + 1];
+        }
+    }
+
+    EncodeFrames(func, frames, offsets);
+    return true;
+}
+
+// Writes out a verification type
+void JavaClassBuilder::EncodeVerifyType(std::vector<unsigned char> &out, JavaVerifyType type, std::vector<int> &offsets) {
+    out.push_back(type.tag);
+
+    int arg = -1;
+    if (type.tag == V_OBJECT) arg = ImportClass(type.className);
+    else if (type.tag == V_UNINIT) arg = offsets[type.newPos];
+
+    if (arg != -1) {
+        out.push_back((arg >> 8) & 0xFF);
+        out.push_back(arg & 0xFF);
+    }
+}
+
+// Builds the StackMapTable for a method
+// Each frame is stored relative to the one before it, using the smallest
+// frame type that can describe the change
+void JavaClassBuilder::EncodeFrames(JavaFunction *func, std::map<int, JavaFrame> &frames, std::vector<int> &offsets) {
+    JavaCodeBlock *block = func->getCodeBlock();
+    block->stackMap.clear();
+    block->frameCount = 0;
+    if (frames.empty()) return;
+
+    if (UTF8Index.find("StackMapTable") == UTF8Index.end()) AddUTF8("StackMapTable");
+    block->stackMapIdx = UTF8Index["StackMapTable"];
+
+    std::vector<unsigned char> &out = block->stackMap;
+    auto writeShort = [&](int value) {
+        out.push_back((value >> 8) & 0xFF);
+        out.push_back(value & 0xFF);
+    };
+
+    std::vector<JavaVerifyType> prev = CompressTypes(GetInitialFrame(func).locals, true);
+    int prevOffset = -1;
+
+    for (auto entry : frames) {
+        int delta = entry.first - prevOffset - 1;
+        prevOffset = entry.first;
+
+        std::vector<JavaVerifyType> locals = CompressTypes(entry.second.locals, true);
+        std::vector<JavaVerifyType> stack = CompressTypes(entry.second.stack, false);
+
+        bool sameLocals = locals == prev;
+        int diff = (int)locals.size() - (int)prev.size();
+        bool isPrefix = true;
+        for (int i = 0; i<locals.size() && i<prev.size(); i++) {
+            if (locals[i] != prev[i]) isPrefix = false;
+        }
+
+        if (sameLocals && stack.size() == 0) {
+            if (delta <= 63) {
+                out.push_back(delta);                           // same_frame
+            } else {
+                out.push_back(251);                             // same_frame_extended
+                writeShort(delta);
+            }
+        } else if (sameLocals && stack.size() == 1) {
+            if (delta <= 63) {
+                out.push_back(64 + delta);                      // same_locals_1_stack_item
+            } else {
+                out.push_back(247);
+                writeShort(delta);
+            }
+            EncodeVerifyType(out, stack[0], offsets);
+        } else if (isPrefix && stack.size() == 0 && diff >= -3 && diff <= -1) {
+            out.push_back(251 + diff);                          // chop_frame
+            writeShort(delta);
+        } else if (isPrefix && stack.size() == 0 && diff >= 1 && diff <= 3) {
+            out.push_back(251 + diff);                          // append_frame
+            writeShort(delta);
+            for (int i = prev.size(); i<locals.size(); i++) EncodeVerifyType(out, locals[i], offsets);
+        } else {
+            out.push_back(255);                                 // full_frame
+            writeShort(delta);
+            writeShort(locals.size());
+            for (JavaVerifyType type : locals) EncodeVerifyType(out, type, offsets);
+            writeShort(stack.size());
+            for (JavaVerifyType type : stack) EncodeVerifyType(out, type, offsets);
+        }
+
+        prev = locals;
+        ++block->frameCount;
+    }
+}
@@ -9,15 +9,21 @@
 #include <vector>
 #include <iostream>
 #include <cstdio>
+#include <cstdint>
 #include <arpa/inet.h>
 
 enum JavaConstTag {
     UTF8 = 0x01,
+    INTEGER = 3,
+    LONG = 5,
     CLASS = 0x07,
     STRING = 8,
     FIELD_REF = 9,
     METHOD_REF = 10,
-    NAME_AND_TYPE = 12
+    NAME_AND_TYPE = 12,
+    METHOD_HANDLE = 15,
+    METHOD_TYPE = 16,
+    INVOKE_DYNAMIC = 18
 };
 
 struct JavaConstEntry {
@@ -51,6 +57,33 @@ private:
     unsigned short nameIndex = 0;
 };
 
+// Represents an integer constant
+struct JavaIntegerEntry : public JavaConstEntry {
+    JavaIntegerEntry(int value) {
+        this->tag = INTEGER;
+        this->value = htonl(value);
+    }
+
+    void write(FILE *file);
+private:
+    unsigned int value = 0;
+};
+
+// Represents a long constant
+// Longs take up two entries in the constant pool; the second is never written
+struct JavaLongEntry : public JavaConstEntry {
+    JavaLongEntry(int64_t value) {
+        this->tag = LONG;
+        this->high = htonl((uint64_t)value >> 32);
+        this->low = htonl((uint64_t)value & 0xFFFFFFFF);
+    }
+
+    void write(FILE *file);
+private:
+    unsigned int high = 0;
+    unsigned int low = 0;
+};
+
 // Represents a UTF-8 constant string
 struct JavaUTF8Entry : public JavaConstEntry {
     JavaUTF8Entry(std::string data) {
@@ -103,12 +136,131 @@ private:
     unsigned short nameIndex, descIndex;
 };
 
+// Represents a method handle entry
+// The kind says how the handle calls the method (6 is invokestatic).
+struct JavaMethodHandleEntry : public JavaConstEntry {
+    JavaMethodHandleEntry(unsigned char kind, unsigned short refIndex) {
+        this->tag = METHOD_HANDLE;
+        this->kind = kind;
+        this->refIndex = refIndex;
+    }
+
+    void write(FILE *file);
+private:
+    unsigned char kind;
+    unsigned short refIndex;
+};
+
+// Represents a method type entry
+struct JavaMethodTypeEntry : public JavaConstEntry {
+    JavaMethodTypeEntry(unsigned short descIndex) {
+        this->tag = METHOD_TYPE;
+        this->descIndex = descIndex;
+    }
+
+    void write(FILE *file);
+private:
+    unsigned short descIndex;
+};
+
+// Represents an invokedynamic call site
+// The bootstrap index is into the class's BootstrapMethods, not the pool.
+struct JavaInvokeDynamicEntry : public JavaConstEntry {
+    JavaInvokeDynamicEntry(unsigned short bootstrapIndex, unsigned short ntIndex) {
+        this->tag = INVOKE_DYNAMIC;
+        this->bootstrapIndex = bootstrapIndex;
+        this->ntIndex = ntIndex;
+    }
+
+    void write(FILE *file);
+private:
+    unsigned short bootstrapIndex, ntIndex;
+};
+
+// An entry in the BootstrapMethods attribute
+struct JavaBootstrapMethod {
+    unsigned short methodHandle = 0;
+    std::vector<unsigned short> args;
+};
+
+// The branch instructions
+enum JavaBranch {
+    B_IFEQ = 0x99,
+    B_IFNE = 0x9A,
+    B_IFLT = 0x9B,
+    B_IFGE = 0x9C,
+    B_IFGT = 0x9D,
+    B_IFLE = 0x9E,
+    B_IF_ICMPEQ = 0x9F,
+    B_IF_ICMPNE = 0xA0,
+    B_IF_ICMPLT = 0xA1,
+    B_IF_ICMPGE = 0xA2,
+    B_IF_ICMPGT = 0xA3,
+    B_IF_ICMPLE = 0xA4,
+    B_IF_ACMPEQ = 0xA5,
+    B_IF_ACMPNE = 0xA6,
+    B_GOTO = 0xA7,
+    B_IFNULL = 0xC6,
+    B_IFNONNULL = 0xC7
+};
+
+// The element types for newarray
+enum JavaArrayType {
+    T_BOOLEAN = 4,
+    T_CHAR = 5,
+    T_FLOAT = 6,
+    T_DOUBLE = 7,
+    T_BYTE = 8,
+    T_SHORT = 9,
+    T_INT = 10,
+    T_LONG = 11
+};
+
+// Returns the branch that jumps when the given one doesn't
+// The conditional branches come in pairs: eq/ne, lt/ge, gt/le
+inline unsigned char InvertBranch(unsigned char opcode) {
+    if (opcode == B_IFNULL) return B_IFNONNULL;
+    if (opcode == B_IFNONNULL) return B_IFNULL;
+    if ((opcode - B_IFEQ) % 2 == 0) return opcode + 1;
+    return opcode - 1;
+}
+
+// The short (slot 0-3) and long opcodes for each kind of local variable op
+struct JavaLocalOp {
+    unsigned char shortOp;
+    unsigned char op;
+};
+
+const JavaLocalOp L_ILOAD = { 0x1A, 0x15 };
+const JavaLocalOp L_LLOAD = { 0x1E, 0x16 };
+const JavaLocalOp L_ALOAD = { 0x2A, 0x19 };
+const JavaLocalOp L_ISTORE = { 0x3B, 0x36 };
+const JavaLocalOp L_LSTORE = { 0x3F, 0x37 };
+const JavaLocalOp L_ASTORE = { 0x4B, 0x3A };
+
+const JavaLocalOp LOCAL_OPS[] = { L_ILOAD, L_LLOAD, L_ALOAD, L_ISTORE, L_LSTORE, L_ASTORE };
+
+// Operands are kept in host order and converted when written
 struct JavaCode {
     unsigned char opcode;
-    unsigned short arg1;            // argPos = 1
+    unsigned short arg1;            // argPos = 1, 3, 4, 5
     unsigned char arg1_byte;        // argPos = 2
+    short arg2 = 0;                 // argPos = 4, 5
 
-    int argPos = 0;
+    int argPos = 0;                 // argPos = 3 -> wide prefix
+                                    // argPos = 4 -> iinc, argPos = 5 -> wide iinc
+                                    // argPos = 6 -> label, argPos = 7 -> branch
+                                    // argPos = 8 -> tableswitch/lookupswitch
+                                    // argPos = 9 -> invokedynamic
+
+    int label = -1;                 // argPos = 6, 7, 8 (default label for a switch)
+    int jump = 0;                   // Branch offset; set when the method is laid out
+    bool far = false;               // Branch needs goto_w
+
+    std::vector<int> keys;          // argPos = 8; only the low key for a tableswitch
+    std::vector<int> labels;        // argPos = 8
+    std::vector<int> jumps;         // argPos = 8; set when the method is laid out
+    int pad = 0;                    // argPos = 8; aligns the operands to 4 bytes
 
     JavaCode(unsigned char opcode) {
         this->opcode = opcode;
@@ -116,7 +268,7 @@ struct JavaCode {
 
     JavaCode(unsigned char opcode, unsigned short arg1) {
         this->opcode = opcode;
-        this->arg1 = htons(arg1);
+        this->arg1 = arg1;
         argPos = 1;
     }
 
@@ -126,16 +278,166 @@ struct JavaCode {
         argPos = 2;
     }
 
+    // Wide form: wide <opcode> <u16>
+    JavaCode(unsigned char opcode, unsigned short arg1, bool wide) {
+        this->opcode = opcode;
+        this->arg1 = arg1;
+        argPos = wide ? 3 : 1;
+    }
+
+    // IINC: iinc <u8 index> <s8 const>, or wide iinc <u16 index> <s16 const>
+    JavaCode(unsigned short index, short amount, bool wide) {
+        this->opcode = 0x84;
+        this->arg1 = index;
+        this->arg2 = amount;
+        argPos = wide ? 5 : 4;
+    }
+
+    // A label marks a position in the code; it takes up no space
+    static JavaCode Label(int label) {
+        JavaCode code(0x00);
+        code.argPos = 6;
+        code.label = label;
+        return code;
+    }
+
+    static JavaCode Branch(unsigned char opcode, int label) {
+        JavaCode code(opcode);
+        code.argPos = 7;
+        code.label = label;
+        return code;
+    }
+
+    // A tableswitch covers every key from keys[0] up, with one label each
+    // A lookupswitch has one label per key; the keys must be sorted
+    static JavaCode Switch(unsigned char opcode, int defaultLabel, std::vector<int> keys, std::vector<int> labels) {
+        JavaCode code(opcode);
+        code.argPos = 8;
+        code.label = defaultLabel;
+        code.keys = keys;
+        code.labels = labels;
+        return code;
+    }
+
+    // invokedynamic <u16 index> 0 0
+    static JavaCode InvokeDynamic(unsigned short index) {
+        JavaCode code(0xBA, index);
+        code.argPos = 9;
+        return code;
+    }
+
+    bool isLabel() { return argPos == 6; }
+    bool isBranch() { return argPos == 7; }
+    bool isSwitch() { return argPos == 8; }
+
+    // Returns true and the slot if this is the given kind of local variable op
+    bool isLocalOp(JavaLocalOp kind, int &slot) {
+        if (argPos == 0 && opcode >= kind.shortOp && opcode <= kind.shortOp + 3) {
+            slot = opcode - kind.shortOp;
+            return true;
+        }
+
+        if (opcode != kind.op) return false;
+        if (argPos == 2) slot = arg1_byte;
+        else if (argPos == 3) slot = arg1;
+        else return false;
+        return true;
+    }
+
     int size() {
+        if (argPos == 6) return 0;
+        if (argPos == 7) {
+            // A far conditional branch becomes: if<!cond> +8; goto_w target
+            if (!far) return 3;
+            return opcode == B_GOTO ? 5 : 8;
+        }
+        if (argPos == 8) {
+            if (opcode == 0xAA) return 1 + pad + 12 + 4 * labels.size();
+            return 1 + pad + 8 + 8 * labels.size();
+        }
         if (argPos == 1) return 3;
+        else if (argPos == 9) return 5;
         else if (argPos == 2) return 2;
+        else if (argPos == 3) return 4;
+        else if (argPos == 4) return 3;
+        else if (argPos == 5) return 6;
         return 1;
     }
 
     void write(FILE *file) {
+        if (argPos == 6) return;
+        if (argPos == 7) {
+            writeBranch(file);
+            return;
+        } else if (argPos == 8) {
+            writeSwitch(file);
+            return;
+        }
+        
+        if (argPos == 3 || argPos == 5) fputc(0xC4, file);
+        fputc(opcode, file);
+        
+        if (argPos == 1 || argPos == 3 || argPos == 5 || argPos == 9) {
+            unsigned short arg = htons(arg1);
+            fwrite(&arg, sizeof(short), 1, file);
+        } else if (argPos == 2) {
+            fputc(arg1_byte, file);
+        } else if (argPos == 4) {
+            fputc((unsigned char)arg1, file);
+            fputc((unsigned char)arg2, file);
+        }
+        
+        if (argPos == 5) {
+            unsigned short arg = htons((unsigned short)arg2);
+            fwrite(&arg, sizeof(short), 1, file);
+        } else if (argPos == 9) {
+            fputc(0, file);
+            fputc(0, file);
+        }
+    }
+    
+    void writeBranch(FILE *file) {
+        if (!far) {
+            fputc(opcode, file);
+            unsigned short arg = htons((unsigned short)jump);
+            fwrite(&arg, sizeof(short), 1, file);
+            return;
+        }
+        
+        int offset = jump;
+        if (opcode != B_GOTO) {
+            fputc(InvertBranch(opcode), file);
+            unsigned short arg = htons(8);
+            fwrite(&arg, sizeof(short), 1, file);
+            offset -= 3;
+        }
+        
+        fputc(0xC8, file);
+        unsigned int arg = htonl((unsigned int)offset);
+        fwrite(&arg, sizeof(int), 1, file);
+    }
+    
+    void writeSwitch(FILE *file) {
+        auto writeInt = [&](int value) {
+            unsigned int arg = htonl((unsigned int)value);
+            fwrite(&arg, sizeof(int), 1, file);
+        };
+        
         fputc(opcode, file);
-        if (argPos == 1) fwrite(&arg1, sizeof(short), 1, file);
-        else if (argPos == 2) fputc(arg1_byte, file);
+        for (int i = 0; i<pad; i++) fputc(0, file);
+        writeInt(jump);
+        
+        if (opcode == 0xAA) {
+            writeInt(keys[0]);
+            writeInt(keys[0] + labels.size() - 1);
+            for (int offset : jumps) writeInt(offset);
+        } else {
+            writeInt(labels.size());
+            for (int i = 0; i<labels.size(); i++) {
+                writeInt(keys[i]);
+                writeInt(jumps[i]);
+            }
+        }
     }
 };
 
@@ -149,8 +451,19 @@ struct JavaCodeBlock {
 
     unsigned short exceptionSize = 0;
     unsigned short attrSize = 0;
+    
+    // The StackMapTable attribute; only written if there are frames
+    unsigned short stackMapIdx = 0;
+    unsigned short frameCount = 0;
+    std::vector<unsigned char> stackMap;
 
     void addCode(JavaCode c) { code.push_back(c); }
+    
+    int getCodeSize() {
+        int codeSize = 0;
+        for (JavaCode c : code) codeSize += c.size();
+        return codeSize;
+    }
 
     void write(FILE *file);
 };
@@ -160,18 +473,33 @@ enum JavaFuncFlags {
     F_PRIVATE = 0x0002,
     F_PROTECTED = 0x0004,
     F_STATIC = 0x0008,
-    F_FINAL = 0x0010
+    F_FINAL = 0x0010,
+    F_SYNTHETIC = 0x1000
 };
 
 struct JavaFunction {
-    JavaFunction(short flags, short nameIdx, short typeIdx, short codeIdx) {
+    JavaFunction(short flags, short nameIdx, short typeIdx, short codeIdx, std::string name = "", std::string signature = "") {
         this->flags = htons(flags);
         this->nameIdx = htons(nameIdx);
         this->typeIdx = htons(typeIdx);
         codeBlock.codeIdx = codeIdx;
+        
+        this->accessFlags = flags;
+        this->name = name;
+        this->signature = signature;
     }
 
     void addCode(JavaCode c) { codeBlock.addCode(c); }
+    void setMaxLocals(int count) { codeBlock.maxVars = htons(count); }
+    void setMaxStack(int count) { codeBlock.stackSize = htons(count); }
+    int getMaxLocals() { return ntohs(codeBlock.maxVars); }
+    JavaCodeBlock *getCodeBlock() { return &codeBlock; }
+    
+    int newLabel() { return labelCount++; }
+    
+    std::string getName() { return name; }
+    std::string getSignature() { return signature; }
+    bool isStatic() { return (accessFlags & F_STATIC) != 0; }
 
     void write(FILE *file) {
         fwrite(&flags, sizeof(short), 1, file);
@@ -188,6 +516,32 @@ private:
     unsigned short attrCount = htons(1);
 
     JavaCodeBlock codeBlock;
+    
+    int accessFlags = 0;
+    std::string name = "";
+    std::string signature = "";
+    int labelCount = 0;
+};
+
+struct JavaField {
+    JavaField(short flags, short nameIdx, short typeIdx) {
+        this->flags = htons(flags);
+        this->nameIdx = htons(nameIdx);
+        this->typeIdx = htons(typeIdx);
+    }
+
+    void write(FILE *file) {
+        fwrite(&flags, sizeof(short), 1, file);
+        fwrite(&nameIdx, sizeof(short), 1, file);
+        fwrite(&typeIdx, sizeof(short), 1, file);
+        fwrite(&attrCount, sizeof(short), 1, file);
+    }
+
+private:
+    unsigned short flags = 0;
+    unsigned short nameIdx = 0;
+    unsigned short typeIdx = 0;
+    unsigned short attrCount = 0;
 };
 
 struct JavaClassFile {
@@ -202,13 +556,19 @@ struct JavaClassFile {
     unsigned short super_idx = 0;
 
     unsigned short interface_count = 0;
-    unsigned short field_count = 0;
+    std::vector<JavaField> fields;
     std::vector<JavaFunction *> methods;
-    unsigned short attr_count = 0;
+    
+    // Only written if there are invokedynamic call sites
+    std::vector<JavaBootstrapMethod> bootstrapMethods;
+    unsigned short bootstrapIdx = 0;
 
     int AddConst(JavaConstEntry *entry) {
         const_pool.push_back(entry);
-        return const_pool.size();
+        int pos = const_pool.size();
+        
+        if (entry->tag == LONG) const_pool.push_back(new JavaConstEntry);
+        return pos;
     }
 
     void write(FILE *file) {
@@ -227,12 +587,37 @@ struct JavaClassFile {
         fwrite(&super_idx, sizeof(short), 1, file);
 
         fwrite(&interface_count, sizeof(short), 1, file);
+        unsigned short field_count = htons(fields.size());
         fwrite(&field_count, sizeof(short), 1, file);
+        for (JavaField &field : fields) field.write(file);
 
         unsigned short func_count = htons(methods.size());
         fwrite(&func_count, sizeof(short), 1, file);
         for (JavaFunction *func : methods) func->write(file);
 
+        unsigned short attr_count = htons(bootstrapMethods.empty() ? 0 : 1);
         fwrite(&attr_count, sizeof(short), 1, file);
+        if (!bootstrapMethods.empty()) writeBootstrapMethods(file);
+    }
+    
+    void writeBootstrapMethods(FILE *file) {
+        unsigned int length = 2;
+        for (JavaBootstrapMethod &method : bootstrapMethods) length += 4 + 2 * method.args.size();
+        
+        auto writeShort = [&](unsigned short value) {
+            value = htons(value);
+            fwrite(&value, sizeof(short), 1, file);
+        };
+        
+        writeShort(bootstrapIdx);
+        length = htonl(length);
+        fwrite(&length, sizeof(int), 1, file);
+        
+        writeShort(bootstrapMethods.size());
+        for (JavaBootstrapMethod &method : bootstrapMethods) {
+            writeShort(method.methodHandle);
+            writeShort(method.args.size());
+            for (unsigned short arg : method.args) writeShort(arg);
+        }
     }
 };
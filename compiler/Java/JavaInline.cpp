@@ -0,0 +1,221 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// JavaInline.cpp
+// Inlines small methods of this class at their call sites
+//
+// Every call to one of our own methods has exactly one target, so a callee under
+// the size threshold is copied straight into the caller. The arguments are stored
+// into locals past the caller's own, the callee's locals are moved up to match,
+// and each return becomes a jump to the end of the copy with the return value
+// left on the stack.
+//
+// Callees are handled before their callers, so a copy already has its own calls
+// inlined. Recursive methods are never inlined.
+#include <map>
+#include <set>
+#include <vector>
+#include <functional>
+
+#include <Java/JavaBuilder.hpp>
+#include <Java/JavaIR.hpp>
+
+// Returns the slot a local variable instruction uses, or -1
+// kind is the entry of LOCAL_OPS it matched, or -1 for an iinc.
+static int GetLocal(JavaCode &code, int &kind) {
+    kind = -1;
+    if (code.opcode == 0x84 && (code.argPos == 4 || code.argPos == 5)) return code.arg1;
+
+    int slot = -1;
+    for (kind = 0; kind<6; kind++) {
+        if (code.isLocalOp(LOCAL_OPS[kind], slot)) return slot;
+    }
+
+    return -1;
+}
+
+// Moves a local variable instruction up by base slots
+static JavaCode RemapLocal(JavaCode code, int base) {
+    int kind = 0;
+    int slot = GetLocal(code, kind);
+
+    if (slot == -1) return code;
+
+    // The amount came from an iinc, so it always fits
+    if (kind == -1) {
+        JavaClassBuilder::EncodeIInc(slot + base, code.arg2, code);
+        return code;
+    }
+    return JavaClassBuilder::EncodeLocalOp(LOCAL_OPS[kind].shortOp, LOCAL_OPS[kind].op, slot + base);
+}
+
+static bool IsReturn(JavaCode &code) {
+    return code.argPos == 0 && (code.opcode == 0xAC || code.opcode == 0xAD || code.opcode == 0xB0 || code.opcode == 0xB1);
+}
+
+// Returns the method of this class an invoke instruction calls, if it's one of ours
+JavaFunction *JavaClassBuilder::FindCallee(JavaCode &code) {
+    if (code.opcode < 0xB6 || code.opcode > 0xB8) return nullptr;
+
+    for (Method &m : methodMap) {
+        if (m.pos != code.arg1) continue;
+        if (m.baseClass != className || m.name == "<init>") return nullptr;
+
+        for (JavaFunction *func : java->methods) {
+            if (func->getName() == m.name && func->getSignature() == m.signature) return func;
+        }
+        return nullptr;
+    }
+
+    return nullptr;
+}
+
+// Inlines calls to small methods throughout the class
+void JavaClassBuilder::RunInliner(int threshold, int maxSize) {
+    std::map<JavaFunction *, std::set<JavaFunction *>> calls;
+    for (JavaFunction *func : java->methods) {
+        for (JavaCode &code : func->getCodeBlock()->code) {
+            JavaFunction *callee = FindCallee(code);
+            if (callee != nullptr) calls[func].insert(callee);
+        }
+    }
+
+    // A method is recursive if it can reach itself
+    std::set<JavaFunction *> recursive;
+    for (JavaFunction *func : java->methods) {
+        std::set<JavaFunction *> seen;
+        std::vector<JavaFunction *> work(calls[func].begin(), calls[func].end());
+
+        while (!work.empty()) {
+            JavaFunction *next = work.back();
+            work.pop_back();
+
+            if (next == func) {
+                recursive.insert(func);
+                break;
+            }
+            if (!seen.insert(next).second) continue;
+            work.insert(work.end(), calls[next].begin(), calls[next].end());
+        }
+    }
+
+    // Callees go before their callers
+    std::vector<JavaFunction *> order;
+    std::set<JavaFunction *> visited;
+    std::function<void(JavaFunction *)> visit = [&](JavaFunction *func) {
+        if (!visited.insert(func).second) return;
+        for (JavaFunction *callee : calls[func]) visit(callee);
+        order.push_back(func);
+    };
+    for (JavaFunction *func : java->methods) visit(func);
+
+    for (JavaFunction *caller : order) {
+        std::vector<JavaCode> &code = caller->getCodeBlock()->code;
+        int base = caller->getMaxLocals();
+        int extra = 0;
+        int callerSize = caller->getCodeBlock()->getCodeSize();
+
+        for (int i = 0; i<code.size(); i++) {
+            JavaFunction *callee = FindCallee(code[i]);
+            if (callee == nullptr) continue;
+
+            std::string site = caller->getName() + " -> " + callee->getName() + ": ";
+            int size = callee->getCodeBlock()->getCodeSize();
+
+            if (recursive.find(callee) != recursive.end()) {
+                inlineReport.push_back(site + "not inlined, recursive");
+                continue;
+            } else if (size > threshold) {
+                inlineReport.push_back(site + "not inlined, too large (" + std::to_string(size) + " > " + std::to_string(threshold) + " bytes)");
+                continue;
+            } else if (callerSize + size > maxSize) {
+                inlineReport.push_back(site + "not inlined, caller would be too large (" + std::to_string(callerSize + size) + " > " + std::to_string(maxSize) + " bytes)");
+                continue;
+            }
+
+            std::vector<JavaCode> copy = InlineCall(caller, callee, base);
+            code.erase(code.begin() + i);
+            code.insert(code.begin() + i, copy.begin(), copy.end());
+            i += copy.size() - 1;
+
+            callerSize += size;
+            extra = std::max(extra, callee->getMaxLocals());
+            inlineReport.push_back(site + "inlined (" + std::to_string(size) + " bytes)");
+        }
+
+        caller->setMaxLocals(base + extra);
+    }
+}
+
+// Builds the code that replaces a call
+// The receiver and arguments are on the stack, last argument on top.
+std::vector<JavaCode> JavaClassBuilder::InlineCall(JavaFunction *caller, JavaFunction *callee, int base) {
+    std::vector<JavaCode> out;
+
+    // Find the slot of each parameter
+    std::vector<char> params;
+    std::vector<int> slots;
+    int slot = callee->isStatic() ? 0 : 1;
+
+    std::string signature = callee->getSignature();
+    for (int i = 1; signature[i] != ')'; i++) {
+        params.push_back(signature[i]);
+        slots.push_back(slot);
+        slot += signature[i] == 'J' ? 2 : 1;
+
+        while (signature[i] == '[') ++i;
+        if (signature[i] == 'L') i = signature.find(';', i);
+    }
+
+    std::vector<JavaCode> &body = callee->getCodeBlock()->code;
+    std::set<int> used;
+    for (JavaCode &code : body) {
+        int kind = 0;
+        int local = GetLocal(code, kind);
+        if (local != -1) used.insert(local);
+    }
+
+    // Pop them into the callee's locals; one it never reads is just dropped
+    for (int i = params.size() - 1; i >= 0; i--) {
+        if (used.find(slots[i]) == used.end()) out.push_back(JavaCode(params[i] == 'J' ? 0x58 : 0x57));
+        else if (params[i] == 'J') out.push_back(EncodeLocalOp(L_LSTORE.shortOp, L_LSTORE.op, base + slots[i]));
+        else if (params[i] == 'L' || params[i] == '[') out.push_back(EncodeLocalOp(L_ASTORE.shortOp, L_ASTORE.op, base + slots[i]));
+        else out.push_back(EncodeLocalOp(L_ISTORE.shortOp, L_ISTORE.op, base + slots[i]));
+    }
+    
+    if (!callee->isStatic()) {
+        if (used.find(0) == used.end()) out.push_back(JavaCode(0x57));
+        else out.push_back(EncodeLocalOp(L_ASTORE.shortOp, L_ASTORE.op, base));
+    }
+
+    // Copy the body with its own labels
+    std::map<int, int> labels;
+    auto remapLabel = [&](int label) {
+        if (labels.find(label) == labels.end()) labels[label] = caller->newLabel();
+        return labels[label];
+    };
+
+    int last = body.size() - 1;
+    while (last >= 0 && body[last].isLabel()) --last;
+
+    int end = caller->newLabel();
+
+    for (int i = 0; i<body.size(); i++) {
+        JavaCode code = RemapLocal(body[i], base);
+
+        if (IsReturn(code)) {
+            if (i != last) out.push_back(JavaCode::Branch(0xA7, end));
+            continue;
+        }
+
+        if (code.isLabel() || code.isBranch() || code.isSwitch()) code.label = remapLabel(code.label);
+        for (int &label : code.labels) label = remapLabel(label);
+
+        out.push_back(code);
+    }
+
+    out.push_back(JavaCode::Label(end));
+    return out;
+}
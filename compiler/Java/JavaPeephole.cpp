@@ -0,0 +1,423 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// JavaPeephole.cpp
+// A peephole optimizer over the generated code of each method
+#include <vector>
+#include <cstdint>
+
+#include <Java/JavaBuilder.hpp>
+#include <Java/JavaIR.hpp>
+
+//
+// The rules
+// Each rule looks at a fixed-size window of instructions. If it matches, it fills
+// in the replacement and returns true. To add a pattern, write the rewrite function
+// and add it to the table below.
+//
+typedef bool (*PeepholeRewrite)(JavaClassBuilder *builder, std::vector<JavaCode> &window, std::vector<JavaCode> &replacement);
+
+struct PeepholeRule {
+    std::string name;
+    int length;
+    PeepholeRewrite rewrite;
+};
+
+// store n; load n -> dup; store n
+static bool RewriteStoreLoad(JavaClassBuilder *builder, std::vector<JavaCode> &window, std::vector<JavaCode> &replacement) {
+    struct Pair { JavaLocalOp store; JavaLocalOp load; unsigned char dup; };
+    const Pair pairs[] = {
+        { L_ISTORE, L_ILOAD, 0x59 },
+        { L_ASTORE, L_ALOAD, 0x59 },
+        { L_LSTORE, L_LLOAD, 0x5C }     // dup2
+    };
+
+    for (Pair pair : pairs) {
+        int storeSlot = 0, loadSlot = 0;
+        if (!window[0].isLocalOp(pair.store, storeSlot)) continue;
+        if (!window[1].isLocalOp(pair.load, loadSlot)) continue;
+        if (storeSlot != loadSlot) continue;
+
+        replacement.push_back(JavaCode(pair.dup));
+        replacement.push_back(window[0]);
+        return true;
+    }
+
+    return false;
+}
+
+// load n; store n -> nothing
+static bool RewriteSelfAssign(JavaClassBuilder *builder, std::vector<JavaCode> &window, std::vector<JavaCode> &replacement) {
+    struct Pair { JavaLocalOp load; JavaLocalOp store; };
+    const Pair pairs[] = {
+        { L_ILOAD, L_ISTORE },
+        { L_ALOAD, L_ASTORE },
+        { L_LLOAD, L_LSTORE }
+    };
+
+    for (Pair pair : pairs) {
+        int loadSlot = 0, storeSlot = 0;
+        if (!window[0].isLocalOp(pair.load, loadSlot)) continue;
+        if (!window[1].isLocalOp(pair.store, storeSlot)) continue;
+        if (loadSlot == storeSlot) return true;
+    }
+
+    return false;
+}
+
+// load n; pop -> nothing
+// Left behind when an inlined method doesn't use one of its arguments
+static bool RewriteLoadPop(JavaClassBuilder *builder, std::vector<JavaCode> &window, std::vector<JavaCode> &replacement) {
+    int slot = 0;
+    if (window[1].argPos != 0) return false;
+
+    if (window[1].opcode == 0x57) return window[0].isLocalOp(L_ILOAD, slot) || window[0].isLocalOp(L_ALOAD, slot);
+    if (window[1].opcode == 0x58) return window[0].isLocalOp(L_LLOAD, slot);
+    return false;
+}
+
+// iload n; <const c>; iadd|isub; istore n -> iinc n c
+static bool RewriteIInc(JavaClassBuilder *builder, std::vector<JavaCode> &window, std::vector<JavaCode> &replacement) {
+    int loadSlot = 0, storeSlot = 0, value = 0;
+    JavaCode iinc(0x84);
+
+    if (!window[3].isLocalOp(L_ISTORE, storeSlot)) return false;
+
+    if (window[0].isLocalOp(L_ILOAD, loadSlot) && builder->GetIntConst(window[1], value)) {
+        if (window[2].opcode == 0x64) {                 // isub
+            if (value == INT32_MIN) return false;       // Its negation doesn't fit in an int
+            value = -value;
+        } else if (window[2].opcode != 0x60) {          // iadd
+            return false;
+        }
+    } else if (builder->GetIntConst(window[0], value) && window[1].isLocalOp(L_ILOAD, loadSlot)) {
+        if (window[2].opcode != 0x60) return false;
+    } else {
+        return false;
+    }
+
+    if (loadSlot != storeSlot) return false;
+    if (!JavaClassBuilder::EncodeIInc(storeSlot, value, iinc)) return false;
+
+    if (value != 0) replacement.push_back(iinc);
+    return true;
+}
+
+// <const identity>; <op> -> nothing
+// x+0, x-0, x|0, x^0, x<<0, x>>0, x>>>0, x*1, x/1, x&-1
+static bool RewriteIdentity(JavaClassBuilder *builder, std::vector<JavaCode> &window, std::vector<JavaCode> &replacement) {
+    int value = 0;
+    if (window[1].argPos != 0 || !builder->GetIntConst(window[0], value)) return false;
+
+    switch (window[1].opcode) {
+        case 0x60:      // iadd
+        case 0x64:      // isub
+        case 0x80:      // ior
+        case 0x82:      // ixor
+        case 0x78:      // ishl
+        case 0x7A:      // ishr
+        case 0x7C:      // iushr
+            return value == 0;
+
+        case 0x68:      // imul
+        case 0x6C:      // idiv
+            return value == 1;
+
+        case 0x7E:      // iand
+            return value == -1;
+
+        default: {}
+    }
+
+    return false;
+}
+
+// ldc/ldc_w of a small Integer -> iconst/bipush/sipush
+static bool RewriteLdc(JavaClassBuilder *builder, std::vector<JavaCode> &window, std::vector<JavaCode> &replacement) {
+    if (window[0].opcode != 0x12 && window[0].opcode != 0x13) return false;
+
+    int value = 0;
+    if (!builder->GetIntConst(window[0], value)) return false;
+
+    JavaCode code(0x00);
+    if (!JavaClassBuilder::EncodeIConst(value, code)) return false;
+
+    replacement.push_back(code);
+    return true;
+}
+
+// Rules are tried in table order, so put the ones that need longer windows
+// first; otherwise a shorter rule can eat part of their pattern
+static const PeepholeRule rules[] = {
+    { "iinc", 4, RewriteIInc },
+    { "identity", 2, RewriteIdentity },
+    { "self-assign", 2, RewriteSelfAssign },
+    { "load-pop", 2, RewriteLoadPop },
+    { "ldc-const", 1, RewriteLdc },
+    { "store-load", 2, RewriteStoreLoad }
+};
+
+//
+// The driver
+//
+
+// A window can't have control flow entering or leaving in the middle of it
+// Labels are fine at the start and branches (or switches) are fine at the end
+static bool CrossesFlow(std::vector<JavaCode> &window) {
+    for (int i = 0; i<window.size(); i++) {
+        if (i > 0 && window[i].isLabel()) return true;
+        if (i < window.size() - 1 && (window[i].isBranch() || window[i].isSwitch())) return true;
+    }
+    return false;
+}
+
+// Runs the peephole rules over every method in the class
+void JavaClassBuilder::RunPeephole() {
+    for (JavaFunction *func : java->methods) {
+        peepholeSaved += RunPeephole(func);
+    }
+}
+
+// Runs the rules over a method until nothing else matches
+// Returns the number of bytes saved
+int JavaClassBuilder::RunPeephole(JavaFunction *func) {
+    std::vector<JavaCode> &code = func->getCodeBlock()->code;
+    int before = func->getCodeBlock()->getCodeSize();
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (PeepholeRule rule : rules) {
+            for (int pos = 0; pos + rule.length <= code.size(); pos++) {
+                std::vector<JavaCode> window(code.begin() + pos, code.begin() + pos + rule.length);
+                std::vector<JavaCode> replacement;
+                if (CrossesFlow(window)) continue;
+                if (!rule.rewrite(this, window, replacement)) continue;
+
+                code.erase(code.begin() + pos, code.begin() + pos + rule.length);
+                code.insert(code.begin() + pos, replacement.begin(), replacement.end());
+
+                ++peepholeHits[rule.name];
+                changed = true;
+            }
+        }
+
+        // Dropping a getstatic can put new pairs next to each other
+        int removed = RemoveRedundantOut(code);
+        if (removed > 0) {
+            peepholeHits["System.out"] += removed;
+            changed = true;
+        }
+    }
+
+    return before - func->getCodeBlock()->getCodeSize();
+}
+
+// Consecutive println calls each start with "getstatic System.out" (or whichever
+// static PrintStream the program writes to). Within a
+// straight-line run, the first one is kept and dup'ed for the next call instead:
+//
+//   getstatic out; <args>; println; ...; getstatic out; <args>; println
+//   getstatic out; dup; <args>; println; ...; <args>; println
+//
+// The copy sits under everything in between, so nothing in between may pop below
+// the depth it started at. Anything we don't know the stack effect of ends the run.
+int JavaClassBuilder::RemoveRedundantOut(std::vector<JavaCode> &code) {
+    auto isOut = [&](JavaCode &c) {
+        return c.opcode == 0xB2 && fieldTypes[c.arg1] == "Ljava/io/PrintStream;";
+    };
+
+    int removed = 0;
+    int pos = 0;
+
+    while (pos < code.size()) {
+        if (!isOut(code[pos])) {
+            ++pos;
+            continue;
+        }
+
+        // The stream reference is on the stack from here
+        int anchor = pos + 1;
+
+        for (;;) {
+            // Find the call that consumes the stream
+            int depth = 1;
+            int consumer = -1;
+            for (int i = anchor; i<code.size(); i++) {
+                int pops = 0, pushes = 0;
+                if (!GetStackEffect(code[i], pops, pushes)) break;
+
+                depth -= pops;
+                if (depth <= 0) {
+                    if (depth == 0 && code[i].opcode == 0xB6) {
+                        for (Method m : methodMap) {
+                            if (m.pos == code[i].arg1 && m.baseClass == "java/io/PrintStream") consumer = i;
+                        }
+                    }
+                    break;
+                }
+                depth += pushes;
+            }
+
+            if (consumer == -1) break;
+
+            // Find the next load of the stream at the same depth
+            depth = 0;
+            int next = -1;
+            for (int i = consumer + 1; i<code.size(); i++) {
+                if (depth == 0 && isOut(code[i]) && code[i].arg1 == code[pos].arg1) {
+                    next = i;
+                    break;
+                }
+
+                int pops = 0, pushes = 0;
+                if (!GetStackEffect(code[i], pops, pushes)) break;
+
+                depth -= pops;
+                if (depth < 0) break;
+                depth += pushes;
+            }
+
+            if (next == -1) break;
+
+            code.insert(code.begin() + anchor, JavaCode(0x59));
+            code.erase(code.begin() + next + 1);
+            ++removed;
+
+            anchor = next + 1;
+        }
+
+        pos = anchor;
+    }
+
+    return removed;
+}
+
+//
+// Instruction info
+//
+
+// Returns the value of an integer constant load
+bool JavaClassBuilder::GetIntConst(JavaCode &code, int &value) {
+    if (code.argPos == 0 && code.opcode >= 0x02 && code.opcode <= 0x08) {
+        value = code.opcode - 0x03;
+        return true;
+    }
+
+    if (code.opcode == 0x10 && code.argPos == 2) {
+        value = (signed char)code.arg1_byte;
+        return true;
+    }
+
+    if (code.opcode == 0x11 && code.argPos == 1) {
+        value = (short)code.arg1;
+        return true;
+    }
+
+    if (code.opcode == 0x12 || code.opcode == 0x13) {
+        int pos = code.opcode == 0x12 ? code.arg1_byte : code.arg1;
+        for (auto entry : intConstMap) {
+            if (entry.second == pos) {
+                value = entry.first;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// Returns the number of stack slots a descriptor type takes up
+static int GetTypeSlots(char c) {
+    if (c == 'V') return 0;
+    if (c == 'J' || c == 'D') return 2;
+    return 1;
+}
+
+// Returns the number of stack slots an instruction pops and pushes
+// Returns false for anything that changes control flow or that we don't know
+bool JavaClassBuilder::GetStackEffect(JavaCode &code, int &pops, int &pushes) {
+    pops = 0;
+    pushes = 0;
+
+    int op = code.opcode;
+
+    if (op >= 0x01 && op <= 0x08) pushes = 1;                           // aconst_null, iconst
+    else if (op == 0x09 || op == 0x0A) pushes = 2;                      // lconst
+    else if (op >= 0x10 && op <= 0x13) pushes = 1;                      // bipush, sipush, ldc
+    else if (op == 0x14) pushes = 2;                                    // ldc2_w
+    else if (op == 0x15 || op == 0x19) pushes = 1;                      // iload, aload
+    else if (op == 0x16) pushes = 2;                                    // lload
+    else if (op >= 0x1A && op <= 0x1D) pushes = 1;                      // iload_n
+    else if (op >= 0x1E && op <= 0x21) pushes = 2;                      // lload_n
+    else if (op >= 0x2A && op <= 0x2D) pushes = 1;                      // aload_n
+    else if (op == 0x2F) { pops = 2; pushes = 2; }                      // laload
+    else if (op >= 0x2E && op <= 0x35) { pops = 2; pushes = 1; }        // *aload
+    else if (op == 0x36 || op == 0x3A) pops = 1;                        // istore, astore
+    else if (op == 0x37) pops = 2;                                      // lstore
+    else if (op >= 0x3B && op <= 0x3E) pops = 1;                        // istore_n
+    else if (op >= 0x3F && op <= 0x42) pops = 2;                        // lstore_n
+    else if (op >= 0x4B && op <= 0x4E) pops = 1;                        // astore_n
+    else if (op == 0x50) pops = 4;                                      // lastore
+    else if (op >= 0x4F && op <= 0x56) pops = 3;                        // *astore
+    else if (op == 0x57) pops = 1;                                      // pop
+    else if (op == 0x58) pops = 2;                                      // pop2
+    else if (op == 0x59) { pops = 1; pushes = 2; }                      // dup
+    else if (op == 0x5A) { pops = 2; pushes = 3; }                      // dup_x1
+    else if (op == 0x5C) { pops = 2; pushes = 4; }                      // dup2
+    else if (op == 0x5F) { pops = 2; pushes = 2; }                      // swap
+    else if (op == 0x79 || op == 0x7B || op == 0x7D) { pops = 3; pushes = 2; }     // long shifts
+    else if (op >= 0x60 && op <= 0x83) {
+        if (op == 0x74) { pops = 1; pushes = 1; }                       // ineg
+        else if (op == 0x75) { pops = 2; pushes = 2; }                  // lneg
+        else if (op % 2 == 0) { pops = 2; pushes = 1; }                 // int math
+        else { pops = 4; pushes = 2; }                                  // long math
+    }
+    else if (op == 0x84) {}                                             // iinc
+    else if (op == 0x85) { pops = 1; pushes = 2; }                      // i2l
+    else if (op == 0x88) { pops = 2; pushes = 1; }                      // l2i
+    else if (op >= 0x91 && op <= 0x93) { pops = 1; pushes = 1; }        // i2b, i2c, i2s
+    else if (op == 0x94) { pops = 4; pushes = 1; }                      // lcmp
+    else if (op == 0xB2) pushes = GetTypeSlots(fieldTypes[code.arg1][0]);      // getstatic
+    else if (op == 0xB3) pops = GetTypeSlots(fieldTypes[code.arg1][0]);        // putstatic
+    else if ((op >= 0xB6 && op <= 0xB8) || op == 0xBA) {                // invoke*
+        std::string signature = "";
+        bool found = false;
+        for (Method m : methodMap) {
+            if (m.pos == code.arg1) {
+                signature = m.signature;
+                found = true;
+                break;
+            }
+        }
+        if (!found) return false;
+
+        if (op != 0xB8 && op != 0xBA) pops = 1;
+
+        int i = 1;
+        while (signature[i] != ')') {
+            if (signature[i] == '[') {
+                while (signature[i] == '[') ++i;
+                if (signature[i] == 'L') i = signature.find(';', i);
+                ++pops;
+            } else if (signature[i] == 'L') {
+                i = signature.find(';', i);
+                ++pops;
+            } else {
+                pops += GetTypeSlots(signature[i]);
+            }
+            ++i;
+        }
+
+        pushes = GetTypeSlots(signature[i + 1]);
+    }
+    else if (op == 0xBB) pushes = 1;                                    // new
+    else if (op >= 0xBC && op <= 0xBE) { pops = 1; pushes = 1; }        // newarray, anewarray, arraylength
+    else if (op == 0xC0) { pops = 1; pushes = 1; }                      // checkcast
+    else return false;
+
+    return true;
+}
@@ -22,6 +22,17 @@ void JavaUTF8Entry::write(FILE *file) {
     for (char c : data) fputc(c, file);
 }
 
+void JavaIntegerEntry::write(FILE *file) {
+    fputc(tag, file);
+    fwrite(&value, sizeof(int), 1, file);
+}
+
+void JavaLongEntry::write(FILE *file) {
+    fputc(tag, file);
+    fwrite(&high, sizeof(int), 1, file);
+    fwrite(&low, sizeof(int), 1, file);
+}
+
 void JavaStringEntry::write(FILE *file) {
     fputc(tag, file);
     fwrite(&nameIndex, sizeof(short), 1, file);
@@ -60,8 +71,14 @@ void JavaNameTypeEntry::write(FILE *file) {
 void JavaCodeBlock::write(FILE *file) {
     codeIdx = htons(codeIdx);
 
-    unsigned int codeSize = 0;
-    for (JavaCode c : code) codeSize += c.size();
+    unsigned int codeSize = getCodeSize();
+    unsigned int attrLength = 0;
+    if (frameCount > 0) {
+        attrSize = htons(1);
+        attrLength = 2 + stackMap.size();
+        size += 6 + attrLength;
+    }
+    
     size = htonl(codeSize + size);
     codeSize = htonl(codeSize);
 
@@ -75,4 +92,39 @@ void JavaCodeBlock::write(FILE *file) {
 
     fwrite(&exceptionSize, sizeof(short), 1, file);
     fwrite(&attrSize, sizeof(short), 1, file);
+    
+    if (frameCount > 0) {
+        unsigned short nameIdx = htons(stackMapIdx);
+        unsigned int length = htonl(attrLength);
+        unsigned short count = htons(frameCount);
+        
+        fwrite(&nameIdx, sizeof(short), 1, file);
+        fwrite(&length, sizeof(int), 1, file);
+        fwrite(&count, sizeof(short), 1, file);
+        for (unsigned char c : stackMap) fputc(c, file);
+    }
+}
+
+void JavaMethodHandleEntry::write(FILE *file) {
+    fputc(tag, file);
+    fputc(kind, file);
+
+    unsigned short index = htons(refIndex);
+    fwrite(&index, sizeof(short), 1, file);
+}
+
+void JavaMethodTypeEntry::write(FILE *file) {
+    fputc(tag, file);
+
+    unsigned short index = htons(descIndex);
+    fwrite(&index, sizeof(short), 1, file);
+}
+
+void JavaInvokeDynamicEntry::write(FILE *file) {
+    fputc(tag, file);
+
+    unsigned short index = htons(bootstrapIndex);
+    fwrite(&index, sizeof(short), 1, file);
+    index = htons(ntIndex);
+    fwrite(&index, sizeof(short), 1, file);
 }
@@ -0,0 +1,249 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <set>
+
+#include <Slots.hpp>
+#include <Walk.hpp>
+
+// Resets the allocator for a new method
+// The parameter slots (including "this") are reserved up front
+void SlotAllocator::Reset(int paramSlots) {
+    used.clear();
+    vars.clear();
+    scopes.clear();
+
+    this->paramSlots = 0;
+    maxLocals = 0;
+
+    Mark(0, paramSlots, true);
+    this->paramSlots = paramSlots;
+    maxLocals = paramSlots;
+}
+
+// Binds a parameter to the next incoming slot
+// Parameters stay live for the whole method
+int SlotAllocator::BindParameter(std::string name, DataType type, DataType subType, std::string className) {
+    LocalVar var;
+    var.slot = paramSlots;
+    var.width = GetWidth(type);
+    var.type = type;
+    var.subType = subType;
+    var.className = className;
+    vars[name] = var;
+
+    Mark(var.slot, var.width, true);
+    paramSlots += var.width;
+    if (paramSlots > maxLocals) maxLocals = paramSlots;
+
+    return var.slot;
+}
+
+// Allocates a slot for a named local in the current scope
+int SlotAllocator::Allocate(std::string name, DataType type, DataType subType, std::string className) {
+    LocalVar var;
+    var.width = GetWidth(type);
+    var.slot = FindFree(var.width);
+    var.type = type;
+    var.subType = subType;
+    var.className = className;
+    vars[name] = var;
+
+    Mark(var.slot, var.width, true);
+    if (!scopes.empty()) scopes.back().push_back(name);
+
+    return var.slot;
+}
+
+// Allocates an unnamed slot for compiler temporaries
+int SlotAllocator::AllocateTemp(int width) {
+    int slot = FindFree(width);
+    Mark(slot, width, true);
+    return slot;
+}
+
+// Returns a named local's slot to the pool
+void SlotAllocator::Release(std::string name) {
+    if (!IsDefined(name)) return;
+
+    LocalVar var = vars[name];
+    if (var.slot < paramSlots) return;
+
+    Mark(var.slot, var.width, false);
+    for (ArrayDim dim : var.dims) {
+        if (dim.slot != -1) Mark(dim.slot, 1, false);
+    }
+    vars.erase(name);
+}
+
+// Records the dimensions of a multi-dimensional array
+// Any slots holding the sizes are released along with the array
+void SlotAllocator::SetDimensions(std::string name, std::vector<ArrayDim> dims) {
+    if (IsDefined(name)) vars[name].dims = dims;
+}
+
+// Returns a temporary slot to the pool
+void SlotAllocator::ReleaseTemp(int slot, int width) {
+    Mark(slot, width, false);
+}
+
+void SlotAllocator::EnterScope() {
+    scopes.push_back(std::vector<std::string>());
+}
+
+// Releases everything still live in the innermost scope
+void SlotAllocator::ExitScope() {
+    if (scopes.empty()) return;
+
+    for (std::string name : scopes.back()) Release(name);
+    scopes.pop_back();
+}
+
+// Returns whether a local was declared in the innermost scope
+bool SlotAllocator::InCurrentScope(std::string name) {
+    if (scopes.empty() || !IsDefined(name)) return false;
+
+    for (std::string current : scopes.back()) {
+        if (current == name) return true;
+    }
+    return false;
+}
+
+// Returns the number of slots a type takes up
+int SlotAllocator::GetWidth(DataType type) {
+    switch (type) {
+        case DataType::Int64:
+        case DataType::UInt64: return 2;
+
+        default: {}
+    }
+
+    return 1;
+}
+
+// Finds the lowest run of free slots of the given width
+int SlotAllocator::FindFree(int width) {
+    int slot = paramSlots;
+    while (slot < used.size()) {
+        bool fits = true;
+        for (int i = slot; i<slot + width && i<used.size(); i++) {
+            if (used[i]) {
+                fits = false;
+                break;
+            }
+        }
+
+        if (fits) return slot;
+        ++slot;
+    }
+
+    return slot;
+}
+
+void SlotAllocator::Mark(int slot, int width, bool inUse) {
+    if (slot + width > used.size()) used.resize(slot + width, false);
+    for (int i = slot; i<slot + width; i++) used[i] = inUse;
+
+    if (slot + width > maxLocals) maxLocals = slot + width;
+}
+
+//
+// Liveness
+//
+// Collects every name a statement mentions
+class NameCollector : public AstWalker {
+public:
+    NameCollector(std::set<std::string> &names) : names(names) {}
+protected:
+    bool Visit(AstStatement *stmt) {
+        switch (stmt->getType()) {
+            case AstType::VarDec: names.insert(static_cast<AstVarDec *>(stmt)->getName()); break;
+            case AstType::VarAssign: names.insert(static_cast<AstVarAssign *>(stmt)->getName()); break;
+            case AstType::ArrayAssign: names.insert(static_cast<AstArrayAssign *>(stmt)->getName()); break;
+            case AstType::FuncCallStmt: names.insert(static_cast<AstFuncCallStmt *>(stmt)->getObjectName()); break;
+            case AstType::For: names.insert(static_cast<AstForStmt *>(stmt)->getIndex()->getValue()); break;
+
+            case AstType::ForAll: {
+                AstForAllStmt *loop = static_cast<AstForAllStmt *>(stmt);
+                names.insert(loop->getIndex()->getValue());
+                names.insert(loop->getArray()->getValue());
+            } break;
+
+            default: {}
+        }
+        return true;
+    }
+
+    bool Visit(AstExpression *expr) {
+        switch (expr->getType()) {
+            case AstType::ID: names.insert(static_cast<AstID *>(expr)->getValue()); break;
+            case AstType::ArrayAccess: names.insert(static_cast<AstArrayAccess *>(expr)->getValue()); break;
+            case AstType::StructAccess: names.insert(static_cast<AstStructAccess *>(expr)->getName()); break;
+
+            case AstType::FuncCallExpr: {
+                AstFuncCallExpr *fc = static_cast<AstFuncCallExpr *>(expr);
+                if (fc->getObjectName() != "") names.insert(fc->getObjectName());
+            } break;
+
+            default: {}
+        }
+        return true;
+    }
+private:
+    std::set<std::string> &names;
+};
+
+// Collects every variable a statement can change
+class AssignFinder : public AstWalker {
+public:
+    AssignFinder(std::set<std::string> &names) : names(names) {}
+protected:
+    bool Visit(AstStatement *stmt) {
+        switch (stmt->getType()) {
+            case AstType::VarDec: names.insert(static_cast<AstVarDec *>(stmt)->getName()); break;
+            case AstType::VarAssign: names.insert(static_cast<AstVarAssign *>(stmt)->getName()); break;
+            case AstType::For: names.insert(static_cast<AstForStmt *>(stmt)->getIndex()->getValue()); break;
+            case AstType::ForAll: names.insert(static_cast<AstForAllStmt *>(stmt)->getIndex()->getValue()); break;
+
+            default: {}
+        }
+        return true;
+    }
+private:
+    std::set<std::string> &names;
+};
+
+void CollectNames(AstStatement *stmt, std::set<std::string> &names) {
+    NameCollector collector(names);
+    collector.Walk(stmt);
+}
+
+// Finds every variable a statement can change
+void FindAssigned(AstStatement *stmt, std::set<std::string> &names) {
+    AssignFinder finder(names);
+    finder.Walk(stmt);
+}
+
+// A name's live range within a block ends with the last top-level statement
+// that mentions it, nested blocks included. A loop that uses a variable keeps
+// it live across the whole loop, since the loop is a single statement here.
+std::map<std::string, int> FindLastUses(AstBlock *block) {
+    std::map<std::string, int> lastUses;
+    std::vector<AstStatement *> stmts = block->getBlock();
+
+    for (int i = 0; i<stmts.size(); i++) {
+        std::set<std::string> names;
+        CollectNames(stmts[i], names);
+
+        for (std::string name : names) {
+            // Structure fields ("s.x") live until the end of their scope, since
+            // a copy of the whole structure uses them without naming them
+            if (name.find('.') != std::string::npos) continue;
+            lastUses[name] = i;
+        }
+    }
+
+    return lastUses;
+}
@@ -0,0 +1,75 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <ast.hpp>
+
+// One dimension of a multi-dimensional array
+// The size is either a constant or kept in its own int slot
+struct ArrayDim {
+    int value = 0;
+    int slot = -1;
+};
+
+// Represents a variable bound to a local slot
+struct LocalVar {
+    int slot = 0;
+    int width = 1;
+    DataType type = DataType::Void;
+    DataType subType = DataType::Void;
+    std::string className = "";
+    std::vector<ArrayDim> dims;     // Only for arrays with more than one dimension
+};
+
+// The per-method local slot allocator
+// Parameters are bound first, in order. Everything else is handed the lowest
+// free slot range; once a variable is dead its slot goes back to the pool, so
+// variables with disjoint live ranges share a slot.
+class SlotAllocator {
+public:
+    void Reset(int paramSlots = 0);
+
+    int BindParameter(std::string name, DataType type, DataType subType = DataType::Void, std::string className = "");
+    int Allocate(std::string name, DataType type, DataType subType = DataType::Void, std::string className = "");
+    int AllocateTemp(int width = 1);
+    void Release(std::string name);
+    void ReleaseTemp(int slot, int width = 1);
+    void SetDimensions(std::string name, std::vector<ArrayDim> dims);
+
+    void EnterScope();
+    void ExitScope();
+    bool InCurrentScope(std::string name);
+
+    bool IsDefined(std::string name) { return vars.find(name) != vars.end(); }
+    LocalVar GetVar(std::string name) { return vars[name]; }
+    int GetSlot(std::string name) { return vars[name].slot; }
+    int GetMaxLocals() { return maxLocals; }
+
+    static int GetWidth(DataType type);
+private:
+    int FindFree(int width);
+    void Mark(int slot, int width, bool inUse);
+
+    std::vector<bool> used;
+    std::map<std::string, LocalVar> vars;
+    std::vector<std::vector<std::string>> scopes;
+    int paramSlots = 0;
+    int maxLocals = 0;
+};
+
+// Returns the index of the last statement in the block that references each name
+std::map<std::string, int> FindLastUses(AstBlock *block);
+
+// Adds every name a statement mentions, nested blocks included
+void CollectNames(AstStatement *stmt, std::set<std::string> &names);
+
+// Adds every variable a statement can change
+void FindAssigned(AstStatement *stmt, std::set<std::string> &names);
@@ -0,0 +1,464 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Split.cpp
+// HotSpot won't JIT-compile a method with more than 8000 bytes of bytecode
+// (DontCompileHugeMethods), and a class file can't hold more than 64KB of code
+// in one method at all. When a method comes out bigger than the limit, runs of
+// its statements are moved into private helper methods, and each run is
+// replaced with a call.
+//
+// A run can be moved if it can't leave the method early (no return, and no
+// break or continue out of it) and doesn't touch a structure or an object.
+// The variables it uses that were declared before it are passed in. If one
+// variable it sets is still needed afterwards, the helper returns it; if more
+// are, they come back through a small array for each type.
+//
+// Runs are taken from the top level of the method. A loop or if that is too
+// big on its own has its body split the same way. Inside a nested block, any
+// outer variable a run sets counts as needed afterwards, since the next trip
+// around a loop may read it.
+#include <set>
+
+#include <Compiler.hpp>
+
+static const int minRun = 64;       // Bytes; anything smaller stays where it is
+static const int maxParamSlots = 254;
+static const int maxResults = 16;
+
+// Returns true if a statement can be moved into a helper
+// loops is how many loops we're inside of within the run.
+static bool CanMove(AstStatement *stmt, int loops, std::set<AstStatement *> &tailCalls) {
+    switch (stmt->getType()) {
+        case AstType::Return:
+        case AstType::StructDec:
+        case AstType::StructAssign: return false;
+
+        case AstType::Break:
+        case AstType::Continue: return loops > 0;
+
+        case AstType::FuncCallStmt: return tailCalls.find(stmt) == tailCalls.end();
+
+        case AstType::If: {
+            AstIfStmt *cond = static_cast<AstIfStmt *>(stmt);
+            for (AstStatement *branch : cond->getBranches()) {
+                if (!CanMove(branch, loops, tailCalls)) return false;
+            }
+        } break;
+
+        case AstType::While:
+        case AstType::Repeat:
+        case AstType::For:
+        case AstType::ForAll: ++loops; break;
+
+        default: {}
+    }
+
+    switch (stmt->getType()) {
+        case AstType::If:
+        case AstType::Elif:
+        case AstType::Else:
+        case AstType::While:
+        case AstType::Repeat:
+        case AstType::For:
+        case AstType::ForAll: {
+            AstBlockStmt *blockStmt = static_cast<AstBlockStmt *>(stmt);
+            for (AstStatement *sub : blockStmt->getBlock()) {
+                if (!CanMove(sub, loops, tailCalls)) return false;
+            }
+        } break;
+
+        default: {}
+    }
+
+    return true;
+}
+
+// Describes a variable from its declaration
+// Arrays and objects are created by the declaration; anything else has no
+// value until the assignment the parser puts after it.
+static SplitVar GetSplitVar(AstVarDec *vd) {
+    SplitVar var;
+    var.type = vd->getDataType();
+    var.subType = vd->getPtrType();
+    var.movable = vd->getDataType() != DataType::Object && vd->getExpressions().size() <= 1;
+    var.assigned = vd->getDataType() == DataType::Array || vd->getDataType() == DataType::Object;
+    return var;
+}
+
+// Returns a variable as an expression the code generator can use
+static AstID *MakeID(std::string name, SplitVar var) {
+    AstID *id = new AstID(name);
+    id->setDataType(var.type, var.subType);
+    if (var.type == DataType::String) id->setClassName("java/lang/String");
+    return id;
+}
+
+// Splits a method that's over the limit
+// The method has already been built once, which tells us how big each
+// statement is. It's split and rebuilt until it fits (or nothing more can be
+// moved), then each helper is built, and split too if it needs to be.
+// reported is where this method's lines start in the tail call report.
+void Compiler::SplitFunction(AstFunction *funcAst, JavaFunction *function, int reported) {
+    int before = function->getCodeBlock()->getCodeSize();
+    std::vector<AstFunction *> helpers;
+
+    while (function->getCodeBlock()->getCodeSize() > options.hugeMethodLimit) {
+        // Where each instruction starts, so a statement's range can be measured
+        std::vector<JavaCode> &code = function->getCodeBlock()->code;
+        codeOffsets.assign(code.size() + 1, 0);
+        for (int i = 0; i<code.size(); i++) codeOffsets[i + 1] = codeOffsets[i] + code[i].size();
+
+        std::map<std::string, SplitVar> scope;
+        for (Var arg : funcAst->getArguments()) {
+            SplitVar var;
+            var.type = arg.type;
+            var.subType = arg.subType;
+            scope[arg.name] = var;
+        }
+
+        int count = helpers.size();
+        SplitBlock(funcAst, funcAst->getBlock(), scope, false, helpers);
+        if (helpers.size() == count) break;
+
+        // Rebuilding reports the method's tail calls again
+        // Once the calls themselves are all that's being moved, we're done
+        int last = codeOffsets.back();
+        tailCallReport.resize(reported);
+        code.clear();
+        BuildFunctionBody(funcAst, function);
+        if (function->getCodeBlock()->getCodeSize() >= last) break;
+    }
+
+    int after = function->getCodeBlock()->getCodeSize();
+    splitReport.push_back(funcAst->getName() + ": " + std::to_string(before) + " -> " + std::to_string(after)
+        + " bytes, " + std::to_string(helpers.size()) + " helpers");
+    if (after > options.hugeMethodLimit) splitReport.back() += " (still over the limit)";
+
+    // A helper is only split again if that's getting somewhere
+    for (AstFunction *helper : helpers) {
+        JavaFunction *helperFunc = funcMap[helper->getName()];
+        int helperReported = tailCallReport.size();
+
+        BuildFunctionBody(helper, helperFunc);
+        int size = helperFunc->getCodeBlock()->getCodeSize();
+        if (size > options.hugeMethodLimit && size < before) {
+            SplitFunction(helper, helperFunc, helperReported);
+        }
+    }
+}
+
+// Returns the size of the code last built for a statement
+int Compiler::GetStatementSize(AstStatement *stmt) {
+    if (codeRanges.find(stmt) == codeRanges.end()) return 0;
+
+    std::pair<int, int> range = codeRanges[stmt];
+    if (range.second >= codeOffsets.size()) return 0;
+    return codeOffsets[range.second] - codeOffsets[range.first];
+}
+
+// Moves runs of statements in a block into helpers
+// scope holds everything declared before the block. nested is true for any
+// block but the method's own.
+void Compiler::SplitBlock(AstFunction *funcAst, AstBlock *block, std::map<std::string, SplitVar> scope,
+                          bool nested, std::vector<AstFunction *> &helpers) {
+    // A run is kept to half the limit, so the helper won't need splitting again
+    int budget = options.hugeMethodLimit / 2;
+
+    std::vector<AstStatement *> stmts = block->getBlock();
+    std::vector<AstStatement *> out;
+    std::map<std::string, int> lastUses = FindLastUses(block);
+
+    auto usedAfter = [&](std::string name, int index) {
+        return lastUses.find(name) != lastUses.end() && lastUses[name] > index;
+    };
+
+    int i = 0;
+    while (i < stmts.size()) {
+        // Grow a run from here for as long as it can be moved
+        // It can't stop between a declaration and its first assignment, or
+        // the variable would come back out before it has a value
+        SplitRun run, best;
+        run.end = best.end = i;
+
+        for (; run.end < stmts.size(); run.end++) {
+            AstStatement *stmt = stmts[run.end];
+            int stmtSize = GetStatementSize(stmt);
+            if (run.size + stmtSize > budget || !CanMove(stmt, 0, tailCalls)) break;
+
+            SplitRun next = run;
+            CollectNames(stmt, next.names);
+            FindAssigned(stmt, next.assigned);
+
+            if (stmt->getType() == AstType::VarDec) {
+                AstVarDec *vd = static_cast<AstVarDec *>(stmt);
+                next.declared[vd->getName()] = GetSplitVar(vd);
+                if (!next.declared[vd->getName()].assigned) next.pending.insert(vd->getName());
+            } else if (stmt->getType() == AstType::VarAssign) {
+                next.pending.erase(static_cast<AstVarAssign *>(stmt)->getName());
+            }
+
+            // Everything from outside has to be something we can pass
+            int slots = IsStaticMethod(funcAst->getName()) ? 0 : 1;
+            bool movable = true;
+            next.params.clear();
+            for (std::string name : next.names) {
+                // A structure's fields are named after it, as in "ps.mass"
+                std::string base = name.substr(0, name.find('.'));
+                if (base != name && scope.find(base) != scope.end() && !scope[base].movable) movable = false;
+
+                if (scope.find(name) == scope.end() || next.declared.find(name) != next.declared.end()) continue;
+                if (!scope[name].movable || !scope[name].assigned) movable = false;
+
+                next.params.push_back(name);
+                slots += SlotAllocator::GetWidth(scope[name].type);
+            }
+
+            // Then everything that's needed afterwards has to be something we can hand back
+            std::set<DataType> holders;
+            next.results.clear();
+            for (std::string name : next.assigned) {
+                SplitVar var;
+                if (next.declared.find(name) != next.declared.end()) {
+                    if (!usedAfter(name, run.end)) continue;
+                    var = next.declared[name];
+                } else if (scope.find(name) != scope.end()) {
+                    if (!nested && !usedAfter(name, run.end)) continue;
+                    var = scope[name];
+                } else {
+                    continue;
+                }
+
+                if (var.type == DataType::Array || !var.movable) movable = false;
+                next.results.push_back(name);
+                holders.insert(var.type);
+            }
+            if (next.results.size() > 1) slots += holders.size();
+            if (!movable || next.results.size() > maxResults || slots > maxParamSlots) break;
+
+            next.size += stmtSize;
+            run = next;
+            if (run.pending.empty()) {
+                best = run;
+                best.end = run.end + 1;
+            }
+        }
+
+        if (best.end > i && best.size >= minRun) {
+            std::vector<AstStatement *> moved(stmts.begin() + i, stmts.begin() + best.end);
+            std::vector<AstStatement *> call = OutlineRun(funcAst, moved, scope, best, helpers);
+            out.insert(out.end(), call.begin(), call.end());
+
+            // A run never ends between a declaration and its assignment
+            for (std::string name : best.results) {
+                if (best.declared.find(name) == best.declared.end()) continue;
+                scope[name] = best.declared[name];
+                scope[name].assigned = true;
+            }
+            i = best.end;
+            continue;
+        }
+
+        // This one stays; if it's too big by itself, try its body
+        AstStatement *stmt = stmts[i];
+        if (GetStatementSize(stmt) > budget) SplitNested(funcAst, stmt, scope, helpers);
+
+        switch (stmt->getType()) {
+            case AstType::VarDec: {
+                AstVarDec *vd = static_cast<AstVarDec *>(stmt);
+                scope[vd->getName()] = GetSplitVar(vd);
+            } break;
+
+            case AstType::VarAssign: {
+                AstVarAssign *va = static_cast<AstVarAssign *>(stmt);
+                if (scope.find(va->getName()) != scope.end()) scope[va->getName()].assigned = true;
+            } break;
+
+            case AstType::StructDec: scope[static_cast<AstStructDec *>(stmt)->getName()].movable = false; break;
+
+            default: {}
+        }
+
+        out.push_back(stmt);
+        ++i;
+    }
+
+    block->addStatements(out);
+}
+
+// Splits the blocks inside a statement
+void Compiler::SplitNested(AstFunction *funcAst, AstStatement *stmt, std::map<std::string, SplitVar> scope,
+                           std::vector<AstFunction *> &helpers) {
+    switch (stmt->getType()) {
+        case AstType::If: {
+            AstIfStmt *cond = static_cast<AstIfStmt *>(stmt);
+            for (AstStatement *branch : cond->getBranches()) SplitNested(funcAst, branch, scope, helpers);
+        } break;
+
+        // The index is an int unless it was declared before the loop
+        case AstType::For: {
+            std::string index = static_cast<AstForStmt *>(stmt)->getIndex()->getValue();
+            if (scope.find(index) == scope.end()) scope[index].type = DataType::Int32;
+        } break;
+
+        case AstType::ForAll: {
+            AstForAllStmt *loop = static_cast<AstForAllStmt *>(stmt);
+            std::string array = loop->getArray()->getValue();
+
+            SplitVar element;
+            if (scope.find(array) != scope.end()) element.type = scope[array].subType;
+            else if (constArrays.find(array) != constArrays.end()) element.type = constArrays[array]->getElementType();
+            else element.movable = false;
+            scope[loop->getIndex()->getValue()] = element;
+        } break;
+
+        default: {}
+    }
+
+    switch (stmt->getType()) {
+        case AstType::If:
+        case AstType::Elif:
+        case AstType::Else:
+        case AstType::While:
+        case AstType::Repeat:
+        case AstType::For:
+        case AstType::ForAll: {
+            AstBlockStmt *blockStmt = static_cast<AstBlockStmt *>(stmt);
+            SplitBlock(funcAst, blockStmt->getBlockStmt(), scope, true, helpers);
+        } break;
+
+        default: {}
+    }
+}
+
+// Moves a run of statements into a new helper
+// Returns the statements that replace it. One value that's needed afterwards
+// is the helper's return value. More than one come back through an array per
+// type, which the caller creates before the call and reads back after it.
+std::vector<AstStatement *> Compiler::OutlineRun(AstFunction *funcAst, std::vector<AstStatement *> stmts,
+                                                 std::map<std::string, SplitVar> &scope, SplitRun &run,
+                                                 std::vector<AstFunction *> &helpers) {
+    std::string number = std::to_string(splitHelpers.size());
+    std::string name = funcAst->getName() + "$" + number;
+    AstFunction *helper = new AstFunction(name, funcAst->isRoutine(), Attr::Private);
+
+    auto getVar = [&](std::string name) {
+        return run.declared.find(name) != run.declared.end() ? run.declared[name] : scope[name];
+    };
+
+    std::vector<Var> args;
+    std::vector<AstExpression *> callArgs;
+    for (std::string param : run.params) {
+        SplitVar var = getVar(param);
+        args.push_back({ param, var.type, var.subType });
+        callArgs.push_back(MakeID(param, var));
+    }
+
+    std::vector<AstStatement *> call;
+    std::map<DataType, std::vector<std::string>> holders;
+    if (run.results.size() > 1) {
+        for (std::string result : run.results) holders[getVar(result).type].push_back(result);
+    }
+
+    int holderIndex = 0;
+    for (auto holder : holders) {
+        SplitVar array;
+        array.type = DataType::Array;
+        array.subType = holder.first;
+
+        std::string arrayName = "out$" + number + "$" + std::to_string(holderIndex++);
+        args.push_back({ arrayName, DataType::Array, holder.first });
+        callArgs.push_back(MakeID(arrayName, array));
+
+        AstInt *length = new AstInt(holder.second.size());
+        AstVarDec *vd = new AstVarDec(arrayName, DataType::Array);
+        vd->setPtrType(holder.first);
+        vd->addExpression(length);
+        vd->setPtrSize(length);
+        call.push_back(vd);
+    }
+    helper->setArguments(args);
+
+    for (AstStatement *stmt : stmts) helper->addStatement(stmt);
+
+    // Fill in the holders, or return the one result
+    AstReturnStmt *ret = new AstReturnStmt;
+    if (run.results.size() == 1) {
+        SplitVar var = getVar(run.results[0]);
+        ret->addExpression(MakeID(run.results[0], var));
+        helper->setDataType(var.type, DataType::Void);
+    }
+
+    holderIndex = 0;
+    for (auto holder : holders) {
+        std::string arrayName = "out$" + number + "$" + std::to_string(holderIndex++);
+        for (int i = 0; i<holder.second.size(); i++) {
+            AstArrayAssign *pa = new AstArrayAssign(arrayName);
+            pa->setDataType(DataType::Array);
+            pa->setPtrType(holder.first);
+            pa->setIndexCount(1);
+            pa->addExpression(new AstInt(i));
+            pa->addExpression(MakeID(holder.second[i], getVar(holder.second[i])));
+            helper->addStatement(pa);
+        }
+    }
+    helper->addStatement(ret);
+
+    // A helper of an instance method keeps "this"; one of a static method is static too
+    funcAsts[name] = helper;
+    if (IsStaticMethod(funcAst->getName()) && !funcAst->isRoutine()) staticMethods.insert(name);
+    splitHelpers.insert(name);
+
+    BuildFunction(helper);
+    helpers.push_back(helper);
+
+    // Now the call, and whatever comes back from it
+    // Anything the run declared is declared again just ahead of its assignment
+    auto declare = [&](std::string result) {
+        if (run.declared.find(result) == run.declared.end()) return;
+
+        AstVarDec *vd = new AstVarDec(result, getVar(result).type);
+        if (getVar(result).type == DataType::String) vd->setClassName("java/lang/String");
+        call.push_back(vd);
+    };
+
+    if (run.results.size() != 1) {
+        AstFuncCallStmt *fc = new AstFuncCallStmt(name);
+        for (AstExpression *arg : callArgs) fc->addExpression(arg);
+        call.push_back(fc);
+    } else {
+        SplitVar var = getVar(run.results[0]);
+        AstFuncCallExpr *fc = new AstFuncCallExpr(name);
+        fc->setArguments(callArgs);
+        fc->setDataType(var.type);
+        if (var.type == DataType::String) fc->setClassName("java/lang/String");
+
+        declare(run.results[0]);
+        AstVarAssign *va = new AstVarAssign(run.results[0]);
+        va->setDataType(var.type);
+        va->addExpression(fc);
+        call.push_back(va);
+    }
+
+    holderIndex = 0;
+    for (auto holder : holders) {
+        std::string arrayName = "out$" + number + "$" + std::to_string(holderIndex++);
+        for (int i = 0; i<holder.second.size(); i++) {
+            std::string result = holder.second[i];
+
+            AstArrayAccess *acc = new AstArrayAccess(arrayName);
+            acc->setIndex(new AstInt(i));
+            acc->setDataType(holder.first);
+
+            declare(result);
+            AstVarAssign *va = new AstVarAssign(result);
+            va->setDataType(holder.first);
+            va->addExpression(acc);
+            call.push_back(va);
+        }
+    }
+
+    return call;
+}
@@ -0,0 +1,164 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Struct.cpp
+// Structures are scalar replaced: a local "s : Point" becomes the locals
+// "s.x" and "s.y", each in its own typed slot. Reading or writing a field is a
+// plain load or store, and nothing is ever allocated on the heap.
+//
+// Arrays of structures are laid out as a structure of arrays: "ps : Point[n]"
+// becomes a packed primitive array per field, so ps[i].x is just "ps.x"[i].
+// A loop over one field walks contiguous memory, with no object per element.
+#include <Compiler.hpp>
+
+// Loads a local onto the stack
+void Compiler::BuildLocalLoad(LocalVar var, JavaFunction *function) {
+    if (var.type == DataType::Int64 || var.type == DataType::UInt64) builder->CreateLLoad(function, var.slot);
+    else if (IsIntType(var.type)) builder->CreateILoad(function, var.slot);
+    else builder->CreateALoad(function, var.slot);
+}
+
+// Stores the top of the stack into a local
+void Compiler::BuildLocalStore(LocalVar var, JavaFunction *function) {
+    if (var.type == DataType::Int64 || var.type == DataType::UInt64) builder->CreateLStore(function, var.slot);
+    else if (IsIntType(var.type)) builder->CreateIStore(function, var.slot);
+    else builder->CreateAStore(function, var.slot);
+}
+
+// Builds a structure variable
+// Every field gets its own local, set to its default or to zero.
+void Compiler::BuildStructDec(AstStatement *stmt, JavaFunction *function) {
+    AstStructDec *sd = static_cast<AstStructDec *>(stmt);
+    AstStruct *str = structs[sd->getStructName()];
+
+    if (sd->isArray()) {
+        BuildStructArray(sd, function);
+        return;
+    }
+
+    for (Var field : str->getFields()) {
+        std::string name = sd->getName() + "." + field.name;
+        std::string className = "";
+        if (field.type == DataType::String) className = "java/lang/String";
+
+        locals.Allocate(name, field.type, field.subType, className);
+        LocalVar var = locals.GetVar(name);
+
+        AstExpression *defaultValue = str->getDefault(field.name);
+        if (defaultValue) {
+            BuildExpr(defaultValue, function);
+        } else if (field.type == DataType::Int64 || field.type == DataType::UInt64) {
+            builder->CreateLConst(function, 0);
+        } else if (IsIntType(field.type)) {
+            builder->CreateIConst(function, 0);
+        } else {
+            builder->CreateString(function, "");
+        }
+
+        BuildLocalStore(var, function);
+    }
+}
+
+// Builds an assignment to a structure field
+void Compiler::BuildStructAssign(AstStatement *stmt, JavaFunction *function) {
+    AstStructAssign *sa = static_cast<AstStructAssign *>(stmt);
+    LocalVar var = locals.GetVar(sa->getName() + "." + sa->getMember());
+
+    if (sa->isIndexed()) {
+        builder->CreateALoad(function, var.slot);
+        BuildExpr(sa->getIndex(), function);
+        BuildExpr(sa->getValue(), function);
+        BuildArrayStore(var.subType, function);
+        return;
+    }
+
+    BuildExpr(sa->getValue(), function);
+    BuildLocalStore(var, function);
+}
+
+// Builds an array of structures
+// Each field gets its own array of the narrowest type that holds it. Primitive
+// arrays start out zeroed, so only fields with a default (and strings, which
+// would otherwise be null) need filling.
+void Compiler::BuildStructArray(AstStructDec *sd, JavaFunction *function) {
+    AstStruct *str = structs[sd->getStructName()];
+
+    int64_t length = 0;
+    bool isLong = false;
+    bool constLength = GetLiteralValue(sd->getExpression(), length, isLong);
+    int lengthPos = -1;
+    if (!constLength) {
+        lengthPos = locals.AllocateTemp();
+        BuildExpr(sd->getExpression(), function);
+        builder->CreateIStore(function, lengthPos);
+    }
+
+    for (Var field : str->getFields()) {
+        std::string name = sd->getName() + "." + field.name;
+        locals.Allocate(name, DataType::Array, field.type);
+        LocalVar var = locals.GetVar(name);
+
+        if (constLength) builder->CreateIConst(function, (int)length);
+        else builder->CreateILoad(function, lengthPos);
+
+        if (field.type == DataType::String) builder->CreateANewArray(function, "java/lang/String");
+        else builder->CreateNewArray(function, GetArrayType(field.type));
+        builder->CreateAStore(function, var.slot);
+
+        AstExpression *defaultValue = str->getDefault(field.name);
+        if (defaultValue || field.type == DataType::String) {
+            BuildFill(var, defaultValue, function);
+        }
+    }
+
+    if (lengthPos != -1) locals.ReleaseTemp(lengthPos);
+}
+
+// Sets every element of an array to a value, or to "" if there isn't one
+void Compiler::BuildFill(LocalVar array, AstExpression *value, JavaFunction *function) {
+    int indexPos = locals.AllocateTemp();
+    int bodyLabel = builder->CreateLabel(function);
+    int condLabel = builder->CreateLabel(function);
+
+    builder->CreateIConst(function, 0);
+    builder->CreateIStore(function, indexPos);
+    builder->CreateGoto(function, condLabel);
+    builder->SetLabel(function, bodyLabel);
+
+    builder->CreateALoad(function, array.slot);
+    builder->CreateILoad(function, indexPos);
+    if (value) BuildExpr(value, function);
+    else builder->CreateString(function, "");
+    BuildArrayStore(array.subType, function);
+    builder->CreateIInc(function, indexPos, 1);
+
+    builder->SetLabel(function, condLabel);
+    builder->CreateILoad(function, indexPos);
+    builder->CreateALoad(function, array.slot);
+    builder->CreateArrayLength(function);
+    builder->CreateBranch(function, B_IF_ICMPLT, bodyLabel);
+
+    locals.ReleaseTemp(indexPos);
+}
+
+// Returns the local for the first field of a structure variable
+// For an array of structures, every field array has the same length.
+LocalVar Compiler::GetFirstField(std::string name, std::string structName) {
+    AstStruct *str = structs[structName];
+    return locals.GetVar(name + "." + str->getFields().front().name);
+}
+
+// Builds a copy of one structure into another, field by field
+void Compiler::BuildStructCopy(AstVarAssign *va, JavaFunction *function) {
+    if (va->getExpression()->getType() != AstType::ID) return;
+    AstID *id = static_cast<AstID *>(va->getExpression());
+    std::string src = id->getValue();
+    AstStruct *str = structs[id->getClassName()];
+
+    for (Var field : str->getFields()) {
+        BuildLocalLoad(locals.GetVar(src + "." + field.name), function);
+        BuildLocalStore(locals.GetVar(va->getName() + "." + field.name), function);
+    }
+}
@@ -31,3 +31,56 @@ std::string GetClassName(std::string input) {
     
     return name;
 }
+
+// Returns true if a type is stored as a JVM int
+bool IsIntType(DataType type) {
+    switch (type) {
+        case DataType::Bool:
+        case DataType::Char:
+        case DataType::Byte:
+        case DataType::UByte:
+        case DataType::Short:
+        case DataType::UShort:
+        case DataType::Int32:
+        case DataType::UInt32: return true;
+        
+        default: {}
+    }
+    
+    return false;
+}
+
+// Returns the JVM descriptor for a type
+// Arrays use the same element types GetArrayType picks for them.
+std::string GetDescriptor(DataType type, DataType subType) {
+    switch (type) {
+        case DataType::Bool: return "Z";
+        case DataType::Char:
+        case DataType::UShort: return "C";
+        case DataType::Byte:
+        case DataType::UByte: return "B";
+        case DataType::Short: return "S";
+        case DataType::Int32:
+        case DataType::UInt32: return "I";
+        case DataType::Int64:
+        case DataType::UInt64: return "J";
+        case DataType::String: return "Ljava/lang/String;";
+        case DataType::Array: return "[" + GetDescriptor(subType);
+        
+        default: {}
+    }
+    
+    return "V";
+}
+
+// Returns the method descriptor for a function
+// main always takes the String array the JVM hands it, whether or not it names it.
+std::string GetSignature(AstFunction *func) {
+    if (func->getName() == "main") return "([Ljava/lang/String;)V";
+    
+    std::string signature = "(";
+    for (Var arg : func->getArguments()) signature += GetDescriptor(arg.type, arg.subType);
+    signature += ")" + GetDescriptor(func->getDataType(), func->getPtrType());
+    
+    return signature;
+}
@@ -0,0 +1,104 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+// Walk.cpp
+// The one place that knows the shape of the AST; the analysis passes subclass
+// AstWalker instead of writing their own recursion.
+#include <Walk.hpp>
+
+bool AstWalker::Walk(std::vector<AstStatement *> block) {
+    for (AstStatement *stmt : block) {
+        if (!Walk(stmt)) return false;
+    }
+
+    return true;
+}
+
+bool AstWalker::Walk(AstStatement *stmt) {
+    if (!Visit(stmt)) return false;
+
+    for (AstExpression *expr : stmt->getExpressions()) {
+        if (!Walk(expr)) return false;
+    }
+
+    switch (stmt->getType()) {
+        case AstType::For: {
+            AstForStmt *loop = static_cast<AstForStmt *>(stmt);
+            if (!Walk(loop->getStartBound()) || !Walk(loop->getEndBound())) return false;
+        } break;
+
+        case AstType::If: {
+            AstIfStmt *cond = static_cast<AstIfStmt *>(stmt);
+            for (AstStatement *branch : cond->getBranches()) {
+                if (!Walk(branch)) return false;
+            }
+        } break;
+
+        default: {}
+    }
+
+    switch (stmt->getType()) {
+        case AstType::If:
+        case AstType::Elif:
+        case AstType::Else:
+        case AstType::While:
+        case AstType::Repeat:
+        case AstType::For:
+        case AstType::ForAll: return Walk(static_cast<AstBlockStmt *>(stmt)->getBlock());
+
+        default: {}
+    }
+
+    return true;
+}
+
+bool AstWalker::Walk(AstExpression *expr) {
+    if (expr == nullptr) return true;
+    if (!Visit(expr)) return false;
+
+    switch (expr->getType()) {
+        case AstType::ArrayAccess: {
+            for (AstExpression *index : static_cast<AstArrayAccess *>(expr)->getIndices()) {
+                if (!Walk(index)) return false;
+            }
+        } break;
+
+        case AstType::Sizeof: return Walk(static_cast<AstSizeof *>(expr)->getValue());
+        case AstType::StructAccess: return Walk(static_cast<AstStructAccess *>(expr)->getIndex());
+
+        case AstType::FuncCallExpr: {
+            for (AstExpression *arg : static_cast<AstFuncCallExpr *>(expr)->getArguments()) {
+                if (!Walk(arg)) return false;
+            }
+        } break;
+
+        case AstType::Neg:
+        case AstType::Convert: return Walk(static_cast<AstUnaryOp *>(expr)->getVal());
+
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Mul:
+        case AstType::Div:
+        case AstType::Rem:
+        case AstType::And:
+        case AstType::Or:
+        case AstType::Xor:
+        case AstType::Lsh:
+        case AstType::Rsh:
+        case AstType::EQ:
+        case AstType::NEQ:
+        case AstType::GT:
+        case AstType::LT:
+        case AstType::GTE:
+        case AstType::LTE: {
+            AstBinaryOp *op = static_cast<AstBinaryOp *>(expr);
+            return Walk(op->getLVal()) && Walk(op->getRVal());
+        }
+
+        default: {}
+    }
+
+    return true;
+}
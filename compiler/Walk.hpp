@@ -0,0 +1,25 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <vector>
+
+#include <ast.hpp>
+
+// A walk over every statement and expression of a block, nested blocks included
+// Each node is visited before its children. A statement's children are its
+// expressions, the bounds of a for loop, the branches of an if, and then its
+// block; loop indexes and forall arrays are left to the statement's visit.
+// A visit that returns false stops the whole walk, and Walk returns false.
+class AstWalker {
+public:
+    bool Walk(std::vector<AstStatement *> block);
+    bool Walk(AstStatement *stmt);
+    bool Walk(AstExpression *expr);
+protected:
+    virtual bool Visit(AstStatement *stmt) { return true; }
+    virtual bool Visit(AstExpression *expr) { return true; }
+};
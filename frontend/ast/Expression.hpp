@@ -19,10 +19,23 @@ public:
         this->type = type;
     }
     
+    // The type worked out by the type checker
+    void setDataType(DataType dataType, DataType subType = DataType::Void) {
+        this->dataType = dataType;
+        this->subType = subType;
+    }
+    void setClassName(std::string className) { this->className = className; }
+    
     AstType getType() { return type; }
+    DataType getDataType() { return dataType; }
+    DataType getSubType() { return subType; }
+    std::string getClassName() { return className; }
     virtual void print() {}
 protected:
     AstType type = AstType::EmptyAst;
+    DataType dataType = DataType::Void;
+    DataType subType = DataType::Void;
+    std::string className = "";
 };
 
 // Represents the base of a unary expression
@@ -46,6 +59,19 @@ public:
     void print();
 };
 
+// Represents a conversion between two types
+// These are put in by the type checker wherever a value is used as another type
+class AstConvertOp : public AstUnaryOp {
+public:
+    explicit AstConvertOp(AstExpression *val, DataType dataType) {
+        this->type = AstType::Convert;
+        this->val = val;
+        this->dataType = dataType;
+    }
+    
+    void print();
+};
+
 // Represents the base of a binary expression
 class AstBinaryOp : public AstExpression {
 public:
@@ -225,6 +251,7 @@ class AstBool : public AstExpression {
 public:
     explicit AstBool(int val) : AstExpression(AstType::BoolL) {
         this->val = val;
+        this->dataType = DataType::Bool;
     }
     
     int getValue() { return val; }
@@ -238,6 +265,7 @@ class AstChar : public AstExpression {
 public:
     explicit AstChar(char val) : AstExpression(AstType::CharL) {
         this->val = val;
+        this->dataType = DataType::Char;
     }
     
     char getValue() { return val; }
@@ -251,6 +279,7 @@ class AstByte : public AstExpression {
 public:
     explicit AstByte(uint8_t val) : AstExpression(AstType::ByteL) {
         this->val = val;
+        this->dataType = DataType::Byte;
     }
     
     uint8_t getValue() { return val; }
@@ -264,6 +293,7 @@ class AstWord : public AstExpression {
 public:
     explicit AstWord(uint16_t val) : AstExpression(AstType::WordL) {
         this->val = val;
+        this->dataType = DataType::Short;
     }
     
     uint16_t getValue() { return val; }
@@ -277,6 +307,7 @@ class AstInt : public AstExpression {
 public:
     explicit AstInt(uint64_t val) : AstExpression(AstType::IntL) {
         this->val = val;
+        this->dataType = DataType::Int32;
     }
     
     void setValue(uint64_t val) { this->val = val; }
@@ -292,6 +323,7 @@ class AstQWord : public AstExpression {
 public:
     explicit AstQWord(uint64_t val) : AstExpression(AstType::QWordL) {
         this->val = val;
+        this->dataType = DataType::Int64;
     }
     
     uint64_t getValue() { return val; }
@@ -305,6 +337,8 @@ class AstString : public AstExpression {
 public:
     explicit AstString(std::string val) : AstExpression(AstType::StringL) {
         this->val = val;
+        this->dataType = DataType::String;
+        this->className = "java/lang/String";
     }
     
     std::string getValue() { return val; }
@@ -333,10 +367,35 @@ public:
         this->val = val;
     }
     
+    // sizeof(m) is the first dimension, sizeof(m[0]) the second, and so on
+    void setDimension(int dimension) { this->dimension = dimension; }
+    
     AstID *getValue() { return val; }
+    int getDimension() { return dimension; }
     void print();
 private:
     AstID *val;
+    int dimension = 0;
+};
+
+// Represents a structure field access
+class AstStructAccess : public AstExpression {
+public:
+    explicit AstStructAccess(std::string name, std::string member) : AstExpression(AstType::StructAccess) {
+        this->name = name;
+        this->member = member;
+    }
+    
+    void setIndex(AstExpression *index) { this->index = index; }
+    
+    std::string getName() { return name; }
+    std::string getMember() { return member; }
+    AstExpression *getIndex() { return index; }     // Only for arrays of structures
+    void print();
+private:
+    std::string name = "";
+    std::string member = "";
+    AstExpression *index = nullptr;
 };
 
 // Represents an array access
@@ -346,14 +405,18 @@ public:
         this->val = val;
     }
     
-    void setIndex(AstExpression *index) { this->index = index; }
+    // Multi-dimensional arrays have one index per dimension
+    void setIndex(AstExpression *index) { indices = { index }; }
+    void addIndex(AstExpression *index) { indices.push_back(index); }
+    void setIndices(std::vector<AstExpression *> indices) { this->indices = indices; }
     
     std::string getValue() { return val; }
-    AstExpression *getIndex() { return index; }
+    AstExpression *getIndex() { return indices.empty() ? nullptr : indices[0]; }
+    std::vector<AstExpression *> getIndices() { return indices; }
     void print();
 private:
     std::string val = "";
-    AstExpression *index;
+    std::vector<AstExpression *> indices;
 };
 
 // Represents a function call
@@ -369,12 +432,15 @@ public:
     
     void addArgument(AstExpression *arg) { args.push_back(arg); }
     void clearArguments() { args.clear(); }
+    void setObjectName(std::string objName) { this->objName = objName; }
     
     std::vector<AstExpression *> getArguments() { return args; }
     std::string getName() { return name; }
+    std::string getObjectName() { return objName; }
     void print();
 private:
     std::vector<AstExpression *> args;
     std::string name = "";
+    std::string objName = "";
 };
 
@@ -7,10 +7,13 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <cstdint>
 
 #include <ast/Types.hpp>
 
 class AstStatement;
+class AstExpression;
 
 // Represents a function, external declaration, or global variable
 class AstGlobalStatement {
@@ -68,3 +71,60 @@ private:
     DataType ptrType = DataType::Void;
 };
 
+// Represents a structure
+// Each field can have a default value; fields without one start at zero
+class AstStruct : public AstGlobalStatement {
+public:
+    explicit AstStruct(std::string name) : AstGlobalStatement(AstType::Struct) {
+        this->name = name;
+    }
+    
+    void addField(Var field, AstExpression *defaultValue = nullptr) {
+        fields.push_back(field);
+        defaults[field.name] = defaultValue;
+    }
+    
+    std::string getName() { return name; }
+    std::vector<Var> getFields() { return fields; }
+    void setDefault(std::string field, AstExpression *defaultValue) { defaults[field] = defaultValue; }
+    AstExpression *getDefault(std::string field) { return defaults[field]; }
+    
+    bool getField(std::string name, Var &field) {
+        for (Var v : fields) {
+            if (v.name == name) {
+                field = v;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    void print() override;
+private:
+    std::string name = "";
+    std::vector<Var> fields;
+    std::map<std::string, AstExpression *> defaults;
+};
+
+// Represents a constant array
+// The elements are all integers, worked out by the parser; the array is built
+// once when the class is loaded.
+class AstConstArray : public AstGlobalStatement {
+public:
+    explicit AstConstArray(std::string name, DataType elementType) : AstGlobalStatement(AstType::ConstArray) {
+        this->name = name;
+        this->elementType = elementType;
+    }
+    
+    void addValue(int64_t value) { values.push_back(value); }
+    
+    std::string getName() { return name; }
+    DataType getElementType() { return elementType; }
+    std::vector<int64_t> getValues() { return values; }
+    
+    void print() override;
+private:
+    std::string name = "";
+    DataType elementType = DataType::Void;
+    std::vector<int64_t> values;
+};
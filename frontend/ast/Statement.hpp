@@ -35,13 +35,22 @@ public:
         expressions.clear();
     }
     
+    void setExpressions(std::vector<AstExpression *> expressions) {
+        this->expressions = expressions;
+    }
+    
+    // The line the statement starts on, for error messages
+    void setLine(int line) { this->line = line; }
+    
     std::vector<AstExpression *> getExpressions() { return expressions; }
     AstExpression *getExpression() { return expressions.at(0); }
     AstType getType() { return type; }
+    int getLine() { return line; }
     virtual void print() {}
 private:
     std::vector<AstExpression *> expressions;
     AstType type = AstType::EmptyAst;
+    int line = 0;
 };
 
 // Represents a function call statement
@@ -127,16 +136,70 @@ public:
     
     void setDataType(DataType dataType) { this->dataType = dataType; }
     void setPtrType(DataType dataType) { this->ptrType = dataType; }
+    void setIndexCount(int count) { this->indexCount = count; }
     
     std::string getName() { return name; }
     DataType getDataType() { return dataType; }
     DataType getPtrType() { return ptrType; }
     
+    // The expressions are the indices (one per dimension), then the value
+    int getIndexCount() { return indexCount; }
+    
     void print();
 private:
     std::string name = "";
     DataType dataType = DataType::Void;
     DataType ptrType = DataType::Void;
+    int indexCount = 1;
+};
+
+// Represents a structure variable declaration
+class AstStructDec : public AstStatement {
+public:
+    explicit AstStructDec(std::string name, std::string structName) : AstStatement(AstType::StructDec) {
+        this->name = name;
+        this->structName = structName;
+    }
+    
+    std::string getName() { return name; }
+    std::string getStructName() { return structName; }
+    
+    // An array of structures has its length as the expression
+    bool isArray() { return getExpressionCount() > 0; }
+    
+    void print();
+private:
+    std::string name = "";
+    std::string structName = "";
+};
+
+// Represents an assignment to a structure field
+class AstStructAssign : public AstStatement {
+public:
+    explicit AstStructAssign(std::string name, std::string member) : AstStatement(AstType::StructAssign) {
+        this->name = name;
+        this->member = member;
+    }
+    
+    void setDataType(DataType dataType) { this->dataType = dataType; }
+    void setIndexed(bool indexed) { this->indexed = indexed; }
+    
+    std::string getName() { return name; }
+    std::string getMember() { return member; }
+    DataType getDataType() { return dataType; }
+    
+    // For an element of an array of structures, the expressions are the index
+    // and then the value
+    bool isIndexed() { return indexed; }
+    AstExpression *getIndex() { return indexed ? getExpressions().front() : nullptr; }
+    AstExpression *getValue() { return getExpressions().back(); }
+    
+    void print();
+private:
+    std::string name = "";
+    std::string member = "";
+    DataType dataType = DataType::Void;
+    bool indexed = false;
 };
 
 // Represents a statement with a sub-block
@@ -11,6 +11,8 @@
 enum class AstType {
     EmptyAst,
     Func,
+    Struct,
+    ConstArray,
     Return,
     
     FuncCallStmt,
@@ -19,6 +21,8 @@ enum class AstType {
     VarDec,
     VarAssign,
     ArrayAssign,
+    StructDec,
+    StructAssign,
     Sizeof,
     
     If,
@@ -34,6 +38,7 @@ enum class AstType {
     Continue,
     
     Neg,
+    Convert,
     
     Add,
     Sub,
@@ -62,7 +67,8 @@ enum class AstType {
     QWordL,
     StringL,
     ID,
-    ArrayAccess
+    ArrayAccess,
+    StructAccess
 };
 
 enum class DataType {
@@ -79,9 +85,13 @@ enum class DataType {
     UInt64,
     String,
     Array,
-    Object
+    Object,
+    Struct
 };
 
+// Returns the name of a type (debug/AstDebug.cpp)
+std::string printDataType(DataType dataType);
+
 enum class Attr {
     Public,
     Protected,
@@ -23,6 +23,7 @@ std::string printDataType(DataType dataType) {
         case DataType::String: return "string";
         case DataType::Array: return "array";
         case DataType::Object: return "object";
+        case DataType::Struct: return "struct";
     }
     return "";
 }
@@ -86,9 +87,11 @@ void AstVarDec::print() {
     std::cout << "VAR_DEC " << name << " : " << printDataType(dataType);
     if (ptrType != DataType::Void) {
         std::cout << "*" << printDataType(ptrType);
-        std::cout << "[";
-        size->print();
-        std::cout << "]";
+        for (auto dim : getExpressions()) {
+            std::cout << "[";
+            dim->print();
+            std::cout << "]";
+        }
     }
     if (dataType == DataType::Object) {
         std::cout << "(" << className << ")";
@@ -96,6 +99,42 @@ void AstVarDec::print() {
     std::cout << std::endl;
 }
 
+void AstStruct::print() {
+    std::cout << "STRUCT " << name << std::endl;
+    for (auto var : fields) {
+        std::cout << "    " << var.name << " : " << printDataType(var.type);
+        if (defaults[var.name]) {
+            std::cout << " := ";
+            defaults[var.name]->print();
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void AstConstArray::print() {
+    std::cout << "CONST " << name << " : " << printDataType(elementType) << "[" << values.size() << "] := [";
+    for (int i = 0; i<values.size(); i++) {
+        if (i > 0) std::cout << ", ";
+        std::cout << values[i];
+    }
+    std::cout << "]" << std::endl << std::endl;
+}
+
+void AstStructDec::print() {
+    std::cout << "    ";
+    std::cout << "STRUCT_DEC " << name << " : " << structName;
+    if (isArray()) std::cout << "[]";
+    std::cout << std::endl;
+}
+
+void AstStructAssign::print() {
+    std::cout << "    ";
+    std::cout << "STRUCT= " << name;
+    if (indexed) std::cout << "[]";
+    std::cout << "." << member << " : " << printDataType(dataType) << std::endl;
+}
+
 void AstVarAssign::print() {
     std::cout << "    ";
     std::cout << "VAR= " << name << " : " << printDataType(dataType);
@@ -448,19 +487,40 @@ void AstID::print() {
     std::cout << val;
 }
 
+void AstConvertOp::print() {
+    std::cout << "(" << printDataType(dataType) << ")(";
+    val->print();
+    std::cout << ")";
+}
+
+void AstStructAccess::print() {
+    std::cout << name;
+    if (index) {
+        std::cout << "[";
+        index->print();
+        std::cout << "]";
+    }
+    std::cout << "." << member;
+}
+
 void AstSizeof::print() {
     std::cout << "SIZEOF(";
     val->print();
+    for (int i = 0; i<dimension; i++) std::cout << "[]";
     std::cout << ")";
 }
 
 void AstArrayAccess::print() {
-    std::cout << val << "[";
-    index->print();
-    std::cout << "]";
+    std::cout << val;
+    for (auto index : indices) {
+        std::cout << "[";
+        index->print();
+        std::cout << "]";
+    }
 }
 
 void AstFuncCallExpr::print() {
+    if (objName != "") std::cout << objName << ".";
     std::cout << name << "(";
     for (auto arg : args) {
         arg->print();
@@ -34,6 +34,7 @@ void Token::print() {
         case Sizeof: std::cout << "SIZEOF"; break;
         case Import: std::cout << "IMPORT"; break;
         case Step: std::cout << "STEP"; break;
+        case Struct: std::cout << "STRUCT"; break;
         
         case Bool: std::cout << "BOOL"; break;
         case Char: std::cout << "CHAR"; break;
@@ -49,6 +50,7 @@ void Token::print() {
         
         case Id: std::cout << "ID "; break;
         case Int32: std::cout << "I32 "; break;
+        case Int64L: std::cout << "I64 " << i64_val << " "; break;
         case True: std::cout << "TRUE "; break;
         case False: std::cout << "FALSE "; break;
         
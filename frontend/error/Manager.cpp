@@ -15,6 +15,15 @@ void ErrorManager::addError(int line, std::string message) {
     errors.push_back(error);
 }
 
+// Adds a type error
+void ErrorManager::addTypeError(int line, std::string message) {
+    Error error;
+    error.line = line;
+    error.message = message;
+    error.kind = "Type Error";
+    errors.push_back(error);
+}
+
 // Adds a syntax warning
 void ErrorManager::addWarning(int line, std::string message) {
     Error error;
@@ -32,7 +41,7 @@ bool ErrorManager::errorsPresent() {
 // Prints any errors
 void ErrorManager::printErrors() {
     for (Error err : errors) {
-        std::cout << "[" << err.line << "] Syntax Error: " << err.message << std::endl;
+        std::cout << "[" << err.line << "] " << err.kind << ": " << err.message << std::endl;
     }
 }
 
@@ -11,11 +11,13 @@
 struct Error {
     int line;
     std::string message;
+    std::string kind = "Syntax Error";
 };
 
 class ErrorManager {
 public:
     void addError(int line, std::string message);
+    void addTypeError(int line, std::string message);
     void addWarning(int line, std::string message);
     bool errorsPresent();
     void printErrors();
@@ -13,6 +13,7 @@ Token::Token() {
     type = EmptyToken;
     id_val = "";
     i32_val = 0;
+    i64_val = 0;
 }
 
 // The scanner functions
@@ -54,6 +55,7 @@ Token Scanner::getNext() {
         }
         
         rawBuffer += next;
+        if (next == '\n') ++currentLine;
         
         if (next == '#') {
             while (next != '\n' && !reader.eof()) {
@@ -138,12 +140,16 @@ Token Scanner::getNext() {
                 break;
             }
             
-            if (isInt()) {
-                token.type = Int32;
-                token.i32_val = std::stoi(buffer);
-            } else if (isHex()) {
-                token.type = Int32;
-                token.i32_val = std::stoi(buffer, 0, 16);
+            // Anything too big for an int is a long literal
+            if (isInt() || isHex()) {
+                uint64_t value = std::stoull(buffer, 0, isHex() ? 16 : 10);
+                if (value <= INT32_MAX) {
+                    token.type = Int32;
+                    token.i32_val = (int)value;
+                } else {
+                    token.type = Int64L;
+                    token.i64_val = (int64_t)value;
+                }
             } else {
                 token.type = Id;
                 token.id_val = buffer;
@@ -232,6 +238,7 @@ TokenType Scanner::getKeyword() {
     else if (buffer == "true") return True;
     else if (buffer == "false") return False;
     else if (buffer == "step") return Step;
+    else if (buffer == "struct") return Struct;
     return EmptyToken;
 }
 
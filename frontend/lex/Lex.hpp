@@ -8,6 +8,7 @@
 #include <fstream>
 #include <string>
 #include <stack>
+#include <cstdint>
 
 // Represents a token
 enum TokenType {
@@ -41,6 +42,7 @@ enum TokenType {
     Sizeof,
     Import,
     Step,
+    Struct,
     
     // Datatype Keywords
     Bool,
@@ -60,6 +62,7 @@ enum TokenType {
     String,
     CharL,
     Int32,
+    Int64L,
     True,
     False,
     
@@ -103,6 +106,7 @@ struct Token {
     std::string id_val;
     char i8_val;
     int i32_val;
+    int64_t i64_val;
     
     Token();
     void print();
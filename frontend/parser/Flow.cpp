@@ -178,10 +178,30 @@ bool Parser::buildForAll(AstBlock *block) {
         return false;
     }
     
-    loop->setArray(new AstID(token.id_val));
+    std::string array = token.id_val;
+    DataType elementType = typeMap[array].second;
     
-    // Make sure we end with the "do" keyword
+    // One field of an array of structures is its own array
     token = scanner->getNext();
+    if (token.type == Dot && structVars.find(array) != structVars.end()) {
+        token = scanner->getNext();
+        Var field;
+        if (token.type != Id || !getStructField(array, token.id_val, field)) {
+            syntax->addError(scanner->getLine(), "Unknown structure member.");
+            return false;
+        }
+        
+        array += "." + token.id_val;
+        elementType = field.type;
+        token = scanner->getNext();
+    }
+    
+    loop->setArray(new AstID(array));
+    
+    // The index holds each element in turn
+    typeMap[loop->getIndex()->getValue()] = std::pair<DataType, DataType>(elementType, DataType::Void);
+    
+    // Make sure we end with the "do" keyword
     if (token.type != Do) {
         syntax->addError(scanner->getLine(), "Expected \"do\".");
         return false;
@@ -85,6 +85,11 @@ bool Parser::buildFunction(Token startToken) {
     typeMap.clear();
     localConsts.clear();
     
+    // Constant arrays can be used from anywhere
+    for (auto entry : constArrays) {
+        typeMap[entry.first] = std::pair<DataType, DataType>(DataType::Array, entry.second);
+    }
+    
     bool isRoutine = false;
     Attr visible = Attr::Public;
     bool attrMod = false;
@@ -134,8 +139,22 @@ bool Parser::buildFunction(Token startToken) {
     if (token.type == Arrow) {
         token = scanner->getNext();
         switch (token.type) {
+            case Bool: funcType = DataType::Bool; break;
+            case Char: funcType = DataType::Char; break;
+            case Byte: funcType = DataType::Byte; break;
+            case UByte: funcType = DataType::UByte; break;
+            case Short: funcType = DataType::Short; break;
+            case UShort: funcType = DataType::UShort; break;
             case Int: funcType = DataType::Int32; break;
-            default: {}
+            case UInt: funcType = DataType::UInt32; break;
+            case Int64: funcType = DataType::Int64; break;
+            case UInt64: funcType = DataType::UInt64; break;
+            case Str: funcType = DataType::String; break;
+            
+            default: {
+                syntax->addError(scanner->getLine(), "Invalid function type.");
+                return false;
+            }
         }
     
         token = scanner->getNext();
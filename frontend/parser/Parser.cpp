@@ -37,6 +37,7 @@ bool Parser::parse() {
             
             case Const: code = buildConst(true); break;
             case Enum: code = buildEnum(); break;
+            case Struct: code = buildStruct(); break;
             
             case Eof:
             case Nl: break;
@@ -68,9 +69,13 @@ bool Parser::buildBlock(AstBlock *block, int stopLayer, AstIfStmt *parentBlock,
         bool code = true;
         bool end = false;
         
+        int line = scanner->getLine();
+        int count = block->getBlock().size();
+        
         switch (token.type) {
             case VarD: code = buildVariableDec(block); break;
             case Const: code = buildConst(false); break;
+            case Struct: code = buildStructDec(block); break;
             
             case Id: {
                 Token idToken = token;
@@ -78,6 +83,8 @@ bool Parser::buildBlock(AstBlock *block, int stopLayer, AstIfStmt *parentBlock,
                 
                 if (token.type == Assign) {
                     code = buildVariableAssign(block, idToken);
+                } else if (token.type == LBracket && structVars.find(idToken.id_val) != structVars.end()) {
+                    code = buildStructElementAssign(block, idToken);
                 } else if (token.type == LBracket) {
                     code = buildArrayAssign(block, idToken);
                 } else if (token.type == LParen) {
@@ -93,6 +100,8 @@ bool Parser::buildBlock(AstBlock *block, int stopLayer, AstIfStmt *parentBlock,
                     token = scanner->getNext();
                     if (token.type == LParen) {
                         code = buildFunctionCallStmt(block, memberToken, idToken);
+                    } else if (token.type == Assign) {
+                        code = buildStructAssign(block, idToken, memberToken);
                     }
                     // TODO: Catch others
                 } else {
@@ -158,6 +167,10 @@ bool Parser::buildBlock(AstBlock *block, int stopLayer, AstIfStmt *parentBlock,
             }
         }
         
+        // Stamp whatever we just added with the line it started on
+        std::vector<AstStatement *> stmts = block->getBlock();
+        for (int i = count; i<stmts.size(); i++) stmts[i]->setLine(line);
+        
         if (end) break;
         if (!code) return false;
         token = scanner->getNext();
@@ -175,10 +188,32 @@ bool Parser::buildExpression(AstStatement *stmt, DataType currentType, TokenType
     DataType varType = currentType;
     
     bool lastWasOp = true;
+    
+    // Applies the operators still on the stack to their operands
+    auto reduce = [&]() {
+        while (opStack.size() > 0) {
+            AstExpression *rval = checkExpression(output.top(), varType);
+            output.pop();
+            
+            AstExpression *lval = checkExpression(output.top(), varType);
+            output.pop();
+            
+            AstBinaryOp *op = static_cast<AstBinaryOp *>(opStack.top());
+            opStack.pop();
+            
+            op->setLVal(lval);
+            op->setRVal(rval);
+            output.push(op);
+        }
+    };
 
     Token token = scanner->getNext();
     while (token.type != Eof && token.type != stopToken) {
         if (token.type == separateToken && output.size() > 0) {
+            // Each argument is its own expression
+            reduce();
+            lastWasOp = true;
+            
             AstExpression *expr = output.top();
             output.pop();
             
@@ -218,6 +253,12 @@ bool Parser::buildExpression(AstStatement *stmt, DataType currentType, TokenType
                 output.push(i32);
             } break;
             
+            case Int64L: {
+                lastWasOp = false;
+                AstQWord *i64 = new AstQWord(token.i64_val);
+                output.push(i64);
+            } break;
+            
             case String: {
                 lastWasOp = false;
                 AstString *str = new AstString(token.id_val);
@@ -243,14 +284,76 @@ bool Parser::buildExpression(AstStatement *stmt, DataType currentType, TokenType
                     AstExpression *index = nullptr;
                     buildExpression(nullptr, DataType::Int32, RBracket, EmptyToken, &index);
                     
+                    // An element of an array of structures
+                    if (structVars.find(name) != structVars.end()) {
+                        token = scanner->getNext();
+                        if (token.type != Dot) {
+                            syntax->addError(scanner->getLine(), "Expected member of structure element.");
+                            return false;
+                        }
+                        
+                        token = scanner->getNext();
+                        Var field;
+                        if (token.type != Id || !getStructField(name, token.id_val, field)) {
+                            syntax->addError(scanner->getLine(), "Unknown structure member.");
+                            return false;
+                        }
+                        if (varType == DataType::Struct) varType = field.type;
+                        
+                        AstStructAccess *acc = new AstStructAccess(name, token.id_val);
+                        acc->setIndex(index);
+                        output.push(acc);
+                        break;
+                    }
+                    
                     AstArrayAccess *acc = new AstArrayAccess(name);
                     acc->setIndex(index);
                     output.push(acc);
+                    
+                    // Any more dimensions
+                    token = scanner->getNext();
+                    while (token.type == LBracket) {
+                        index = nullptr;
+                        buildExpression(nullptr, DataType::Int32, RBracket, EmptyToken, &index);
+                        acc->addIndex(index);
+                        token = scanner->getNext();
+                    }
+                    scanner->rewind(token);
                 } else if (token.type == LParen) {
                     AstFuncCallExpr *fc = new AstFuncCallExpr(name);
                     AstExpression *fcExpr = fc;
                     buildExpression(nullptr, varType, RParen, Comma, &fcExpr);
                     
+                    output.push(fc);
+                } else if (token.type == Dot && structVars.find(name) != structVars.end()) {
+                    token = scanner->getNext();
+                    if (token.type != Id) {
+                        syntax->addError(scanner->getLine(), "Expected member name.");
+                        return false;
+                    }
+                    
+                    Var field;
+                    if (!getStructField(name, token.id_val, field)) {
+                        syntax->addError(scanner->getLine(), "Unknown structure member.");
+                        return false;
+                    }
+                    if (varType == DataType::Struct) varType = field.type;
+                    
+                    output.push(new AstStructAccess(name, token.id_val));
+                } else if (token.type == Dot) {
+                    // A method call on an object
+                    Token memberToken = scanner->getNext();
+                    token = scanner->getNext();
+                    if (memberToken.type != Id || token.type != LParen) {
+                        syntax->addError(scanner->getLine(), "Expected method call.");
+                        return false;
+                    }
+                    
+                    AstFuncCallExpr *fc = new AstFuncCallExpr(memberToken.id_val);
+                    fc->setObjectName(name);
+                    AstExpression *fcExpr = fc;
+                    buildExpression(nullptr, DataType::Void, RParen, Comma, &fcExpr);
+                    
                     output.push(fc);
                 } else if (token.type == Scope) {
                     if (enums.find(name) == enums.end()) {
@@ -300,6 +403,15 @@ bool Parser::buildExpression(AstStatement *stmt, DataType currentType, TokenType
                 Token token2 = scanner->getNext();
                 Token token3 = scanner->getNext();
                 
+                // sizeof(m[0]) is the size of the second dimension; the index
+                // itself doesn't matter
+                int dimension = 0;
+                while (token3.type == LBracket) {
+                    while (token3.type != RBracket && token3.type != Eof) token3 = scanner->getNext();
+                    token3 = scanner->getNext();
+                    ++dimension;
+                }
+                
                 if (token1.type != LParen || token2.type != Id || token3.type != RParen) {
                     syntax->addError(scanner->getLine(), "Invalid token in sizeof.");
                     token.print();
@@ -308,6 +420,7 @@ bool Parser::buildExpression(AstStatement *stmt, DataType currentType, TokenType
                 
                 AstID *id = new AstID(token2.id_val);
                 AstSizeof *size = new AstSizeof(id);
+                size->setDimension(dimension);
                 output.push(size);
             } break;
             
@@ -423,20 +536,7 @@ bool Parser::buildExpression(AstStatement *stmt, DataType currentType, TokenType
     }
     
     // Build the expression
-    while (opStack.size() > 0) {
-        AstExpression *rval = checkExpression(output.top(), varType);
-        output.pop();
-        
-        AstExpression *lval = checkExpression(output.top(), varType);
-        output.pop();
-        
-        AstBinaryOp *op = static_cast<AstBinaryOp *>(opStack.top());
-        opStack.pop();
-        
-        op->setLVal(lval);
-        op->setRVal(rval);
-        output.push(op);
-    }
+    reduce();
     
     // Add the expressions back
     if (output.size() == 0) {
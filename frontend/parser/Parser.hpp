@@ -38,6 +38,7 @@ protected:
     bool buildVariableAssign(AstBlock *block, Token idToken);
     bool buildArrayAssign(AstBlock *block, Token idToken);
     bool buildConst(bool isGlobal);
+    bool buildConstArray(std::string name, DataType dataType, bool isGlobal);
     
     // Flow.cpp
     bool buildConditional(AstBlock *block);
@@ -53,7 +54,9 @@ protected:
     bool buildEnum();
     bool buildStruct();
     bool buildStructDec(AstBlock *block);
-    bool buildStructAssign(AstBlock *block, Token idToken);
+    bool buildStructAssign(AstBlock *block, Token idToken, Token memberToken);
+    bool buildStructElementAssign(AstBlock *block, Token idToken);
+    bool getStructField(std::string name, std::string member, Var &field);
     
     bool buildBlock(AstBlock *block, int stopLayer = 0, AstIfStmt *parentBlock = nullptr, bool inElif = false);
     bool buildExpression(AstStatement *stmt, DataType currentType,
@@ -72,6 +75,9 @@ private:
     std::map<std::string, std::pair<DataType,DataType>> typeMap;
     std::map<std::string, std::pair<DataType, AstExpression*>> globalConsts;
     std::map<std::string, std::pair<DataType, AstExpression*>> localConsts;
+    std::map<std::string, DataType> constArrays;        // Name -> element type
     std::map<std::string, EnumDec> enums;
+    std::map<std::string, AstStruct *> structs;
+    std::map<std::string, std::string> structVars;      // Variable -> structure name
 };
 
@@ -97,3 +97,202 @@ bool Parser::buildEnum() {
     
     return true;
 }
+
+// Parses and builds a structure
+// struct Name is
+//     field : type [:= default];
+// end
+bool Parser::buildStruct() {
+    Token token = scanner->getNext();
+    std::string name = token.id_val;
+    
+    if (token.type != Id) {
+        syntax->addError(scanner->getLine(), "Expected structure name.");
+        return false;
+    }
+    
+    token = scanner->getNext();
+    if (token.type != Is) {
+        syntax->addError(scanner->getLine(), "Expected \"is\"");
+        return false;
+    }
+    
+    AstStruct *str = new AstStruct(name);
+    
+    token = scanner->getNext();
+    while (token.type != End && token.type != Eof) {
+        Var field;
+        field.name = token.id_val;
+        field.subType = DataType::Void;
+        
+        if (token.type != Id) {
+            syntax->addError(scanner->getLine(), "Expected field name.");
+            return false;
+        }
+        
+        token = scanner->getNext();
+        if (token.type != Colon) {
+            syntax->addError(scanner->getLine(), "Expected \':\'.");
+            return false;
+        }
+        
+        token = scanner->getNext();
+        switch (token.type) {
+            case Bool: field.type = DataType::Bool; break;
+            case Char: field.type = DataType::Char; break;
+            case Byte: field.type = DataType::Byte; break;
+            case UByte: field.type = DataType::UByte; break;
+            case Short: field.type = DataType::Short; break;
+            case UShort: field.type = DataType::UShort; break;
+            case Int: field.type = DataType::Int32; break;
+            case UInt: field.type = DataType::UInt32; break;
+            case Int64: field.type = DataType::Int64; break;
+            case UInt64: field.type = DataType::UInt64; break;
+            case Str: field.type = DataType::String; break;
+            
+            default: {
+                syntax->addError(scanner->getLine(), "Invalid type for structure field.");
+                return false;
+            }
+        }
+        
+        token = scanner->getNext();
+        AstExpression *defaultValue = nullptr;
+        
+        if (token.type == Assign) {
+            AstVarAssign *empty = new AstVarAssign("");
+            if (!buildExpression(empty, field.type)) return false;
+            defaultValue = empty->getExpression();
+        } else if (token.type != SemiColon) {
+            syntax->addError(scanner->getLine(), "Expected \';\'.");
+            return false;
+        }
+        
+        str->addField(field, defaultValue);
+        token = scanner->getNext();
+    }
+    
+    // A structure only exists as its fields
+    if (str->getFields().empty()) {
+        syntax->addError(scanner->getLine(), "Structures must have at least one field.");
+        return false;
+    }
+    
+    structs[name] = str;
+    tree->addGlobalStatement(str);
+    
+    return true;
+}
+
+// Parses a structure variable
+// struct name : Name;
+bool Parser::buildStructDec(AstBlock *block) {
+    Token token = scanner->getNext();
+    std::string name = token.id_val;
+    
+    if (token.type != Id) {
+        syntax->addError(scanner->getLine(), "Expected variable name.");
+        return false;
+    }
+    
+    token = scanner->getNext();
+    if (token.type != Colon) {
+        syntax->addError(scanner->getLine(), "Expected \':\'.");
+        return false;
+    }
+    
+    token = scanner->getNext();
+    if (token.type != Id || structs.find(token.id_val) == structs.end()) {
+        syntax->addError(scanner->getLine(), "Unknown structure.");
+        return false;
+    }
+    
+    std::string structName = token.id_val;
+    AstStructDec *sd = new AstStructDec(name, structName);
+    typeMap[name] = std::pair<DataType, DataType>(DataType::Struct, DataType::Void);
+    
+    // An array of structures
+    // struct name : Name[length];
+    token = scanner->getNext();
+    if (token.type == LBracket) {
+        if (!buildExpression(sd, DataType::Int32, RBracket)) return false;
+        typeMap[name] = std::pair<DataType, DataType>(DataType::Array, DataType::Struct);
+        token = scanner->getNext();
+    }
+    
+    if (token.type != SemiColon) {
+        syntax->addError(scanner->getLine(), "Expected \';\'.");
+        return false;
+    }
+    
+    block->addStatement(sd);
+    structVars[name] = structName;
+    
+    return true;
+}
+
+// Parses an assignment to a structure field
+// The variable, dot, member, and assignment have already been read
+bool Parser::buildStructAssign(AstBlock *block, Token idToken, Token memberToken) {
+    if (structVars.find(idToken.id_val) == structVars.end()) {
+        syntax->addError(scanner->getLine(), "Unknown structure variable.");
+        return false;
+    }
+    
+    Var field;
+    if (!getStructField(idToken.id_val, memberToken.id_val, field)) {
+        syntax->addError(scanner->getLine(), "Unknown structure member.");
+        return false;
+    }
+    
+    AstStructAssign *sa = new AstStructAssign(idToken.id_val, memberToken.id_val);
+    sa->setDataType(field.type);
+    block->addStatement(sa);
+    
+    if (!buildExpression(sa, field.type)) return false;
+    
+    return true;
+}
+
+// Parses an assignment to a field of an element in an array of structures
+// The variable and the opening bracket have already been read
+// name[index].member := value;
+bool Parser::buildStructElementAssign(AstBlock *block, Token idToken) {
+    AstExpression *index = nullptr;
+    if (!buildExpression(nullptr, DataType::Int32, RBracket, EmptyToken, &index)) return false;
+    
+    Token token = scanner->getNext();
+    if (token.type != Dot) {
+        syntax->addError(scanner->getLine(), "Expected member of structure element.");
+        return false;
+    }
+    
+    token = scanner->getNext();
+    Var field;
+    if (token.type != Id || !getStructField(idToken.id_val, token.id_val, field)) {
+        syntax->addError(scanner->getLine(), "Unknown structure member.");
+        return false;
+    }
+    
+    AstStructAssign *sa = new AstStructAssign(idToken.id_val, token.id_val);
+    sa->setDataType(field.type);
+    sa->setIndexed(true);
+    sa->addExpression(index);
+    block->addStatement(sa);
+    
+    token = scanner->getNext();
+    if (token.type != Assign) {
+        syntax->addError(scanner->getLine(), "Expected \':=\'.");
+        return false;
+    }
+    
+    if (!buildExpression(sa, field.type)) return false;
+    
+    return true;
+}
+
+// Looks up a field of a structure variable
+bool Parser::getStructField(std::string name, std::string member, Var &field) {
+    if (structVars.find(name) == structVars.end()) return false;
+    return structs[structVars[name]]->getField(member, field);
+}
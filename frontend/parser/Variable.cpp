@@ -76,6 +76,14 @@ bool Parser::buildVariableDec(AstBlock *block) {
         }
         
         for (std::string name : toDeclare) {
+            // A structure isn't an object; it lives in the function
+            if (structs.find(className) != structs.end()) {
+                block->addStatement(new AstStructDec(name, className));
+                typeMap[name] = std::pair<DataType, DataType>(DataType::Struct, DataType::Void);
+                structVars[name] = className;
+                continue;
+            }
+            
             AstVarDec *vd = new AstVarDec(name, dataType);
             vd->setClassName(className);
             block->addStatement(vd);
@@ -89,7 +97,13 @@ bool Parser::buildVariableDec(AstBlock *block) {
         AstVarDec *empty = new AstVarDec("", DataType::Array);
         if (!buildExpression(empty, DataType::Int32, RBracket)) return false;   
         
+        // More dimensions; each one's size is another expression
         token = scanner->getNext();
+        while (token.type == LBracket) {
+            if (!buildExpression(empty, DataType::Int32, RBracket)) return false;
+            token = scanner->getNext();
+        }
+        
         if (token.type != SemiColon) {
             syntax->addError(scanner->getLine(), "Error: Expected \';\'.");
             return false;
@@ -98,7 +112,7 @@ bool Parser::buildVariableDec(AstBlock *block) {
         for (std::string name : toDeclare) {
             AstVarDec *vd = new AstVarDec(name, DataType::Array);
             block->addStatement(vd);
-            vd->addExpression(empty->getExpression());
+            for (AstExpression *dim : empty->getExpressions()) vd->addExpression(dim);
             vd->setPtrType(dataType);
             
             // Create an assignment to a malloc call
@@ -108,7 +122,7 @@ bool Parser::buildVariableDec(AstBlock *block) {
             block->addStatement(va);
             
             AstFuncCallExpr *callMalloc = new AstFuncCallExpr("malloc");
-            callMalloc->setArguments(vd->getExpressions());
+            callMalloc->setArguments({ vd->getExpression() });
             va->addExpression(callMalloc);
             
             // In order to get a proper malloc, we need to multiply the argument by
@@ -182,6 +196,12 @@ bool Parser::buildArrayAssign(AstBlock *block, Token idToken) {
     if (!buildExpression(pa, DataType::Int32, RBracket)) return false;
     
     Token token = scanner->getNext();
+    while (token.type == LBracket) {
+        if (!buildExpression(pa, DataType::Int32, RBracket)) return false;
+        token = scanner->getNext();
+    }
+    pa->setIndexCount(pa->getExpressionCount());
+    
     if (token.type != Assign) {
         syntax->addError(scanner->getLine(), "Expected \'=\' after array assignment.");
         return false;
@@ -235,6 +255,8 @@ bool Parser::buildConst(bool isGlobal) {
     
     // Final syntax check
     token = scanner->getNext();
+    if (token.type == LBracket) return buildConstArray(name, dataType, isGlobal);
+    
     if (token.type != Assign) {
         syntax->addError(scanner->getLine(), "Expected \'=\' after const assignment.");
         return false;
@@ -253,3 +275,82 @@ bool Parser::buildConst(bool isGlobal) {
     
     return true;
 }
+
+// Works out the value of one element of a constant array
+static bool GetConstValue(AstExpression *expr, int64_t &value) {
+    switch (expr->getType()) {
+        case AstType::BoolL: value = static_cast<AstBool *>(expr)->getValue(); break;
+        case AstType::CharL: value = static_cast<AstChar *>(expr)->getValue(); break;
+        case AstType::ByteL: value = static_cast<AstByte *>(expr)->getValue(); break;
+        case AstType::WordL: value = static_cast<AstWord *>(expr)->getValue(); break;
+        case AstType::IntL: value = (int32_t)static_cast<AstInt *>(expr)->getValue(); break;
+        case AstType::QWordL: value = (int64_t)static_cast<AstQWord *>(expr)->getValue(); break;
+        
+        case AstType::Neg: {
+            if (!GetConstValue(static_cast<AstNegOp *>(expr)->getVal(), value)) return false;
+            value = -value;
+        } break;
+        
+        default: return false;
+    }
+    
+    return true;
+}
+
+// Builds a constant array
+// const NAME : type[] := [ value, value, ... ];
+// The opening bracket after the type has already been read.
+bool Parser::buildConstArray(std::string name, DataType dataType, bool isGlobal) {
+    if (!isGlobal) {
+        syntax->addError(scanner->getLine(), "Constant arrays must be declared globally.");
+        return false;
+    }
+    
+    if (dataType == DataType::String) {
+        syntax->addError(scanner->getLine(), "Constant arrays can only hold integers.");
+        return false;
+    }
+    
+    Token token = scanner->getNext();
+    if (token.type != RBracket) {
+        syntax->addError(scanner->getLine(), "Expected \']\' in constant array.");
+        return false;
+    }
+    
+    token = scanner->getNext();
+    if (token.type != Assign) {
+        syntax->addError(scanner->getLine(), "Expected \'=\' after const assignment.");
+        return false;
+    }
+    
+    token = scanner->getNext();
+    if (token.type != LBracket) {
+        syntax->addError(scanner->getLine(), "Expected \'[\' to start the array.");
+        return false;
+    }
+    
+    // The elements are read like the arguments of a call
+    AstFuncCallExpr *list = new AstFuncCallExpr("");
+    AstExpression *listExpr = list;
+    if (!buildExpression(nullptr, dataType, RBracket, Comma, &listExpr, true)) return false;
+    
+    AstConstArray *array = new AstConstArray(name, dataType);
+    for (AstExpression *element : list->getArguments()) {
+        int64_t value = 0;
+        if (!GetConstValue(element, value)) {
+            syntax->addError(scanner->getLine(), "Invalid constant value.");
+            return false;
+        }
+        array->addValue(value);
+    }
+    
+    token = scanner->getNext();
+    if (token.type != SemiColon) {
+        syntax->addError(scanner->getLine(), "Expected \';\'.");
+        return false;
+    }
+    
+    tree->addGlobalStatement(array);
+    constArrays[name] = dataType;
+    return true;
+}
@@ -0,0 +1,744 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#include <cstdint>
+
+#include <sema/TypeCheck.hpp>
+
+//
+// Helpers
+//
+
+// Returns true for the types that are numbers on the JVM (bool included)
+static bool IsIntegral(DataType type) {
+    switch (type) {
+        case DataType::Bool:
+        case DataType::Char:
+        case DataType::Byte:
+        case DataType::UByte:
+        case DataType::Short:
+        case DataType::UShort:
+        case DataType::Int32:
+        case DataType::UInt32:
+        case DataType::Int64:
+        case DataType::UInt64: return true;
+
+        default: {}
+    }
+
+    return false;
+}
+
+static bool IsLong(DataType type) {
+    return type == DataType::Int64 || type == DataType::UInt64;
+}
+
+// Returns the range of values a sub-word type holds
+// Int and wider return false; any int fits in their bits.
+static bool GetRange(DataType type, int64_t &min, int64_t &max) {
+    switch (type) {
+        case DataType::Bool: min = 0; max = 1; break;
+        case DataType::Byte: min = INT8_MIN; max = INT8_MAX; break;
+        case DataType::UByte: min = 0; max = UINT8_MAX; break;
+        case DataType::Short: min = INT16_MIN; max = INT16_MAX; break;
+        case DataType::Char:
+        case DataType::UShort: min = 0; max = UINT16_MAX; break;
+
+        default: return false;
+    }
+
+    return true;
+}
+
+// The type a value is converted to before it's stored in an array
+// The array stores truncate to their element width themselves.
+static DataType GetElementStoreType(DataType type) {
+    switch (type) {
+        case DataType::Char:
+        case DataType::Byte:
+        case DataType::UByte:
+        case DataType::Short:
+        case DataType::UShort: return DataType::Int32;
+
+        default: {}
+    }
+
+    return type;
+}
+
+// The type a value is widened to before arithmetic
+// Everything that fits in an int becomes one, like C's integer promotion.
+static DataType Promote(DataType type) {
+    switch (type) {
+        case DataType::UInt32:
+        case DataType::Int64:
+        case DataType::UInt64: return type;
+
+        default: {}
+    }
+
+    return DataType::Int32;
+}
+
+// The type both sides of a binary operation are converted to
+// Unsigned wins at the same width.
+static DataType GetCommonType(DataType lval, DataType rval) {
+    lval = Promote(lval);
+    rval = Promote(rval);
+
+    if (IsLong(lval) || IsLong(rval)) {
+        if (lval == DataType::UInt64 || rval == DataType::UInt64) return DataType::UInt64;
+        return DataType::Int64;
+    }
+
+    if (lval == DataType::UInt32 || rval == DataType::UInt32) return DataType::UInt32;
+    return DataType::Int32;
+}
+
+static bool GetLiteral(AstExpression *expr, int64_t &value) {
+    switch (expr->getType()) {
+        case AstType::BoolL: value = static_cast<AstBool *>(expr)->getValue(); break;
+        case AstType::CharL: value = static_cast<AstChar *>(expr)->getValue(); break;
+        case AstType::ByteL: value = static_cast<AstByte *>(expr)->getValue(); break;
+        case AstType::WordL: value = static_cast<AstWord *>(expr)->getValue(); break;
+        case AstType::IntL: value = (int32_t)static_cast<AstInt *>(expr)->getValue(); break;
+        case AstType::QWordL: value = (int64_t)static_cast<AstQWord *>(expr)->getValue(); break;
+
+        default: return false;
+    }
+
+    return true;
+}
+
+// Returns true for a structure, or an array of them
+static bool IsStruct(Symbol var) {
+    if (var.type == DataType::Array) return var.subType == DataType::Struct;
+    return var.type == DataType::Struct;
+}
+
+static std::string GetOperator(AstType type) {
+    switch (type) {
+        case AstType::Add: return "+";
+        case AstType::Sub: return "-";
+        case AstType::Mul: return "*";
+        case AstType::Div: return "/";
+        case AstType::Rem: return "%";
+        case AstType::And: return "&";
+        case AstType::Or: return "|";
+        case AstType::Xor: return "^";
+        case AstType::Lsh: return "<<";
+        case AstType::Rsh: return ">>";
+        case AstType::EQ: return "=";
+        case AstType::NEQ: return "!=";
+        case AstType::GT: return ">";
+        case AstType::LT: return "<";
+        case AstType::GTE: return ">=";
+        case AstType::LTE: return "<=";
+
+        default: {}
+    }
+
+    return "?";
+}
+
+//
+// The pass
+//
+
+TypeChecker::TypeChecker(AstTree *tree, ErrorManager *errors) {
+    this->tree = tree;
+    this->errors = errors;
+}
+
+// Checks the whole tree
+// Returns false if there were any type errors
+bool TypeChecker::check() {
+    for (AstGlobalStatement *GS : tree->getGlobalStatements()) {
+        if (GS->getType() == AstType::Func) {
+            AstFunction *func = static_cast<AstFunction *>(GS);
+            functions[func->getName()] = func;
+        } else if (GS->getType() == AstType::Struct) {
+            AstStruct *str = static_cast<AstStruct *>(GS);
+            structs[str->getName()] = str;
+
+            for (Var field : str->getFields()) {
+                AstExpression *defaultValue = str->getDefault(field.name);
+                if (defaultValue == nullptr) continue;
+
+                str->setDefault(field.name, convert(checkExpr(defaultValue), field.type));
+            }
+        } else if (GS->getType() == AstType::ConstArray) {
+            AstConstArray *array = static_cast<AstConstArray *>(GS);
+            globals[array->getName()].type = DataType::Array;
+            globals[array->getName()].subType = array->getElementType();
+            globals[array->getName()].isConst = true;
+        }
+    }
+
+    for (AstGlobalStatement *GS : tree->getGlobalStatements()) {
+        if (GS->getType() == AstType::Func) checkFunction(static_cast<AstFunction *>(GS));
+    }
+
+    return !errors->errorsPresent();
+}
+
+void TypeChecker::checkFunction(AstFunction *func) {
+    current = func;
+    loops = 0;
+    scopes.clear();
+    scopes.push_back(std::map<std::string, Symbol>());
+
+    for (Var arg : func->getArguments()) {
+        std::string className = "";
+        if (arg.type == DataType::String) className = "java/lang/String";
+        declare(arg.name, arg.type, arg.subType, className);
+    }
+
+    checkBlock(func->getBlock());
+    scopes.clear();
+}
+
+// Each block is its own scope
+void TypeChecker::checkBlock(AstBlock *block) {
+    scopes.push_back(std::map<std::string, Symbol>());
+    for (AstStatement *stmt : block->getBlock()) checkStatement(stmt);
+    scopes.pop_back();
+}
+
+void TypeChecker::checkStatement(AstStatement *stmt) {
+    if (stmt->getLine() > 0) line = stmt->getLine();
+    std::vector<AstExpression *> exprs = stmt->getExpressions();
+
+    switch (stmt->getType()) {
+        case AstType::VarDec: {
+            AstVarDec *vd = static_cast<AstVarDec *>(stmt);
+
+            // The expressions of an array are the size of each dimension
+            for (int i = 0; i<exprs.size(); i++) exprs[i] = convert(checkExpr(exprs[i]), DataType::Int32);
+            stmt->setExpressions(exprs);
+            if (vd->getPtrSize()) vd->setPtrSize(exprs[0]);
+
+            if (vd->getDataType() == DataType::Array) {
+                declare(vd->getName(), DataType::Array, vd->getPtrType());
+            } else if (vd->getDataType() == DataType::String) {
+                declare(vd->getName(), DataType::String, DataType::Void, "java/lang/String");
+            } else {
+                declare(vd->getName(), vd->getDataType(), DataType::Void, vd->getClassName());
+            }
+        } break;
+
+        case AstType::VarAssign: {
+            AstVarAssign *va = static_cast<AstVarAssign *>(stmt);
+            Symbol var;
+            if (!lookup(va->getName(), var)) {
+                error("Unknown variable \"" + va->getName() + "\".");
+                break;
+            }
+            if (var.isConst) {
+                error("Cannot assign to constant array \"" + va->getName() + "\".");
+                break;
+            }
+
+            // Arrays get their memory from the declaration
+            if (var.type == DataType::Array && exprs[0]->getType() == AstType::FuncCallExpr) {
+                if (static_cast<AstFuncCallExpr *>(exprs[0])->getName() == "malloc") break;
+            }
+
+            // A copy is the one place a whole structure can be used
+            if (var.type == DataType::Struct) {
+                checkStructCopy(va->getName(), var, exprs[0]);
+                break;
+            }
+
+            exprs[0] = convert(checkExpr(exprs[0]), var.type);
+            stmt->setExpressions(exprs);
+        } break;
+
+        case AstType::ArrayAssign: {
+            AstArrayAssign *pa = static_cast<AstArrayAssign *>(stmt);
+            Symbol array;
+            if (!lookup(pa->getName(), array) || array.type != DataType::Array) {
+                error("\"" + pa->getName() + "\" is not an array.");
+                break;
+            }
+            if (array.isConst) {
+                error("Cannot assign to constant array \"" + pa->getName() + "\".");
+                break;
+            }
+
+            for (int i = 0; i<pa->getIndexCount(); i++) exprs[i] = convert(checkExpr(exprs[i]), DataType::Int32);
+            exprs.back() = convert(checkExpr(exprs.back()), GetElementStoreType(array.subType));
+            stmt->setExpressions(exprs);
+        } break;
+
+        case AstType::StructDec: {
+            AstStructDec *sd = static_cast<AstStructDec *>(stmt);
+
+            if (sd->isArray()) {
+                exprs[0] = convert(checkExpr(exprs[0]), DataType::Int32);
+                stmt->setExpressions(exprs);
+                declare(sd->getName(), DataType::Array, DataType::Struct, sd->getStructName());
+            } else {
+                declare(sd->getName(), DataType::Struct, DataType::Void, sd->getStructName());
+            }
+        } break;
+
+        case AstType::StructAssign: {
+            AstStructAssign *sa = static_cast<AstStructAssign *>(stmt);
+            Var field;
+            if (!lookupField(sa->getName(), sa->getMember(), field)) {
+                error("Unknown structure member \"" + sa->getName() + "." + sa->getMember() + "\".");
+                break;
+            }
+
+            DataType type = field.type;
+            if (sa->isIndexed()) {
+                exprs[0] = convert(checkExpr(exprs[0]), DataType::Int32);
+                type = GetElementStoreType(type);
+            }
+
+            exprs.back() = convert(checkExpr(exprs.back()), type);
+            stmt->setExpressions(exprs);
+        } break;
+
+        case AstType::FuncCallStmt: {
+            AstFuncCallStmt *fc = static_cast<AstFuncCallStmt *>(stmt);
+            checkReceiver(fc->getObjectName(), fc->getName());
+            checkCall(fc->getName(), exprs);
+            stmt->setExpressions(exprs);
+        } break;
+
+        case AstType::Break:
+        case AstType::Continue: {
+            if (loops == 0) error("break/continue outside of a loop.");
+        } break;
+
+        case AstType::Return: {
+            if (exprs.empty()) break;
+
+            exprs[0] = convert(checkExpr(exprs[0]), current->getDataType());
+            stmt->setExpressions(exprs);
+        } break;
+
+        case AstType::If:
+        case AstType::Elif:
+        case AstType::Else:
+        case AstType::While:
+        case AstType::Repeat: {
+            if (!exprs.empty()) {
+                exprs[0] = checkCondition(exprs[0]);
+                stmt->setExpressions(exprs);
+            }
+
+            bool isLoop = stmt->getType() == AstType::While || stmt->getType() == AstType::Repeat;
+            AstBlockStmt *blockStmt = static_cast<AstBlockStmt *>(stmt);
+            if (isLoop) ++loops;
+            checkBlock(blockStmt->getBlockStmt());
+            if (isLoop) --loops;
+
+            if (stmt->getType() == AstType::If) {
+                AstIfStmt *cond = static_cast<AstIfStmt *>(stmt);
+                for (AstStatement *branch : cond->getBranches()) checkStatement(branch);
+            }
+        } break;
+
+        case AstType::For: {
+            AstForStmt *loop = static_cast<AstForStmt *>(stmt);
+            loop->setStartBound(convert(checkExpr(loop->getStartBound()), DataType::Int32));
+            loop->setEndBound(convert(checkExpr(loop->getEndBound()), DataType::Int32));
+
+            scopes.push_back(std::map<std::string, Symbol>());
+            // An existing variable can be the index, but the loop steps it as an int
+            Symbol index;
+            std::string name = loop->getIndex()->getValue();
+            if (!lookup(name, index)) declare(name, DataType::Int32);
+            else if (index.type != DataType::Int32) error("The index of a for loop must be an int; \"" + name + "\" is " + printDataType(index.type) + ".");
+            checkExpr(loop->getIndex());
+
+            ++loops;
+            checkBlock(loop->getBlockStmt());
+            --loops;
+            scopes.pop_back();
+        } break;
+
+        case AstType::ForAll: {
+            AstForAllStmt *loop = static_cast<AstForAllStmt *>(stmt);
+            std::string name = loop->getArray()->getValue();
+
+            // Either an array, or one field of an array of structures
+            Symbol array;
+            Var field;
+            size_t dot = name.find('.');
+            if (dot != std::string::npos && lookupField(name.substr(0, dot), name.substr(dot + 1), field)) {
+                array.type = DataType::Array;
+                array.subType = field.type;
+            } else if (!lookup(name, array) || array.type != DataType::Array) {
+                error("\"" + name + "\" is not an array.");
+                break;
+            } else if (array.subType == DataType::Struct) {
+                error("Structure \"" + name + "\" can only be looped over one field at a time.");
+                break;
+            }
+            loop->getArray()->setDataType(DataType::Array, array.subType);
+
+            scopes.push_back(std::map<std::string, Symbol>());
+            std::string className = "";
+            if (array.subType == DataType::String) className = "java/lang/String";
+            declare(loop->getIndex()->getValue(), array.subType, DataType::Void, className);
+            checkExpr(loop->getIndex());
+
+            ++loops;
+            checkBlock(loop->getBlockStmt());
+            --loops;
+            scopes.pop_back();
+        } break;
+
+        default: {}
+    }
+}
+
+// Checks a copy of one structure into another
+// The source has to be a structure of the same kind, named directly.
+void TypeChecker::checkStructCopy(std::string name, Symbol var, AstExpression *expr) {
+    Symbol src;
+    if (expr->getType() == AstType::ID && lookup(static_cast<AstID *>(expr)->getValue(), src)) {
+        if (src.type == DataType::Struct && src.className == var.className) {
+            expr->setDataType(DataType::Struct);
+            expr->setClassName(src.className);
+            return;
+        }
+
+        if (IsStruct(src)) {
+            error("Cannot assign structure \"" + static_cast<AstID *>(expr)->getValue() + "\" to structure \"" + name + "\".");
+            return;
+        }
+    }
+
+    expr = checkExpr(expr);
+    error("Cannot assign " + printDataType(expr->getDataType()) + " to structure \"" + name + "\".");
+}
+
+// Checks the object a method is called on
+// A routine has no "this", so it can only call our methods through an object.
+void TypeChecker::checkReceiver(std::string name, std::string method) {
+    if (name == "" || name == "this") {
+        if (!current->isRoutine() || functions.find(method) == functions.end()) return;
+        if (name == "" && functions[method]->isRoutine()) return;
+
+        error("Cannot call method \"" + method + "\" without an object from routine \"" + current->getName() + "\".");
+        return;
+    }
+
+    Symbol var;
+    if (!lookup(name, var) || !IsStruct(var)) return;
+
+    error("Structure \"" + name + "\" has no methods.");
+}
+
+// Checks the arguments of a call
+// Calls to our own functions convert each argument to its parameter's type.
+void TypeChecker::checkCall(std::string name, std::vector<AstExpression *> &args) {
+    for (int i = 0; i<args.size(); i++) args[i] = checkExpr(args[i]);
+
+    if (functions.find(name) == functions.end()) return;
+    std::vector<Var> params = functions[name]->getArguments();
+
+    if (params.size() != args.size()) {
+        error("Wrong number of arguments to \"" + name + "\".");
+        return;
+    }
+
+    for (int i = 0; i<args.size(); i++) args[i] = convert(args[i], params[i].type);
+}
+
+// Works out the type of an expression and stores it on the node
+// Returns the expression to use in its place
+AstExpression *TypeChecker::checkExpr(AstExpression *expr) {
+    if (expr == nullptr) return nullptr;
+
+    switch (expr->getType()) {
+        // Literals know their own type
+        case AstType::BoolL:
+        case AstType::CharL:
+        case AstType::ByteL:
+        case AstType::WordL:
+        case AstType::IntL:
+        case AstType::QWordL:
+        case AstType::StringL:
+        case AstType::Convert: break;
+
+        case AstType::ID: {
+            AstID *id = static_cast<AstID *>(expr);
+            Symbol var;
+            if (!lookup(id->getValue(), var)) {
+                error("Unknown variable \"" + id->getValue() + "\".");
+                break;
+            }
+
+            // Structures only exist as their fields, so there's no value to use
+            if (IsStruct(var)) {
+                error("Structure \"" + id->getValue() + "\" can only be copied to another structure.");
+                break;
+            }
+
+            id->setDataType(var.type, var.subType);
+            id->setClassName(var.className);
+        } break;
+
+        case AstType::ArrayAccess: {
+            AstArrayAccess *acc = static_cast<AstArrayAccess *>(expr);
+            Symbol array;
+            if (!lookup(acc->getValue(), array) || array.type != DataType::Array) {
+                error("\"" + acc->getValue() + "\" is not an array.");
+                break;
+            }
+
+            std::vector<AstExpression *> indices;
+            for (AstExpression *index : acc->getIndices()) indices.push_back(convert(checkExpr(index), DataType::Int32));
+            acc->setIndices(indices);
+
+            acc->setDataType(array.subType);
+            if (array.subType == DataType::String) acc->setClassName("java/lang/String");
+        } break;
+
+        case AstType::StructAccess: {
+            AstStructAccess *acc = static_cast<AstStructAccess *>(expr);
+            Var field;
+            if (!lookupField(acc->getName(), acc->getMember(), field)) {
+                error("Unknown structure member \"" + acc->getName() + "." + acc->getMember() + "\".");
+                break;
+            }
+
+            if (acc->getIndex()) acc->setIndex(convert(checkExpr(acc->getIndex()), DataType::Int32));
+
+            acc->setDataType(field.type);
+            if (field.type == DataType::String) acc->setClassName("java/lang/String");
+        } break;
+
+        // Code generation finds arrays of structures from the operand's type
+        case AstType::Sizeof: {
+            AstID *id = static_cast<AstSizeof *>(expr)->getValue();
+            expr->setDataType(DataType::Int32);
+
+            Symbol var;
+            if (!lookup(id->getValue(), var)) {
+                error("Unknown variable \"" + id->getValue() + "\".");
+            } else if (var.type != DataType::Array) {
+                error("\"" + id->getValue() + "\" is not an array.");
+            } else {
+                id->setDataType(var.type, var.subType);
+                id->setClassName(var.className);
+            }
+        } break;
+
+        case AstType::FuncCallExpr: {
+            AstFuncCallExpr *fc = static_cast<AstFuncCallExpr *>(expr);
+            std::vector<AstExpression *> args = fc->getArguments();
+            checkReceiver(fc->getObjectName(), fc->getName());
+            checkCall(fc->getName(), args);
+            fc->setArguments(args);
+
+            // Anything we don't know about is another class's business
+            if (functions.find(fc->getName()) == functions.end()) break;
+
+            AstFunction *callee = functions[fc->getName()];
+            fc->setDataType(callee->getDataType(), callee->getPtrType());
+            if (callee->getDataType() == DataType::String) fc->setClassName("java/lang/String");
+        } break;
+
+        case AstType::Neg: {
+            AstNegOp *op = static_cast<AstNegOp *>(expr);
+            op->setVal(checkExpr(op->getVal()));
+
+            DataType type = op->getVal()->getDataType();
+            if (!IsIntegral(type)) {
+                error("Cannot negate " + printDataType(type) + ".");
+                break;
+            }
+
+            DataType result = Promote(type);
+            op->setVal(convert(op->getVal(), result));
+            op->setDataType(result);
+        } break;
+
+        case AstType::Add:
+        case AstType::Sub:
+        case AstType::Mul:
+        case AstType::Div:
+        case AstType::Rem:
+        case AstType::And:
+        case AstType::Or:
+        case AstType::Xor:
+        case AstType::Lsh:
+        case AstType::Rsh:
+        case AstType::EQ:
+        case AstType::NEQ:
+        case AstType::GT:
+        case AstType::LT:
+        case AstType::GTE:
+        case AstType::LTE: return checkBinary(static_cast<AstBinaryOp *>(expr));
+
+        default: {}
+    }
+
+    return expr;
+}
+
+// Checks the condition of an if, elif, or loop
+// Any integer works; it's compared against zero.
+AstExpression *TypeChecker::checkCondition(AstExpression *expr) {
+    expr = checkExpr(expr);
+
+    DataType type = expr->getDataType();
+    if (type != DataType::Void && !IsIntegral(type)) {
+        error("Condition can't be " + printDataType(type) + ".");
+    }
+
+    return expr;
+}
+
+// Works out the type of a binary operation
+// Both sides are converted to a common type first; shifts keep the type of
+// their left side and always shift by an int.
+AstExpression *TypeChecker::checkBinary(AstBinaryOp *op) {
+    op->setLVal(checkExpr(op->getLVal()));
+    op->setRVal(checkExpr(op->getRVal()));
+
+    AstType type = op->getType();
+    DataType ltype = op->getLVal()->getDataType();
+    DataType rtype = op->getRVal()->getDataType();
+    bool isCompare = (type >= AstType::EQ && type <= AstType::LTE);
+
+    // Joining strings
+    if (type == AstType::Add && (ltype == DataType::String || rtype == DataType::String)) {
+        op->setDataType(DataType::String);
+        op->setClassName("java/lang/String");
+        return op;
+    }
+
+    // Calls we know nothing about; leave them to the JVM
+    if (ltype == DataType::Void || rtype == DataType::Void) {
+        op->setDataType(isCompare ? DataType::Bool : DataType::Int32);
+        return op;
+    }
+
+    if (!IsIntegral(ltype) || !IsIntegral(rtype)) {
+        error("Invalid operands to " + GetOperator(type) + ": " + printDataType(ltype) + " and " + printDataType(rtype) + ".");
+        return op;
+    }
+
+    // Logic on two bools stays a bool
+    bool isLogic = (type == AstType::And || type == AstType::Or || type == AstType::Xor);
+    if (isLogic && ltype == DataType::Bool && rtype == DataType::Bool) {
+        op->setDataType(DataType::Bool);
+        return op;
+    }
+
+    if (type == AstType::Lsh || type == AstType::Rsh) {
+        DataType result = Promote(ltype);
+        op->setLVal(convert(op->getLVal(), result));
+        op->setRVal(convert(op->getRVal(), DataType::Int32));
+        op->setDataType(result);
+        return op;
+    }
+
+    DataType common = GetCommonType(ltype, rtype);
+    op->setLVal(convert(op->getLVal(), common));
+    op->setRVal(convert(op->getRVal(), common));
+    op->setDataType(isCompare ? DataType::Bool : common);
+
+    return op;
+}
+
+// Converts an expression to a type, if it needs it
+// Literals are rewritten rather than converted at runtime.
+AstExpression *TypeChecker::convert(AstExpression *expr, DataType type) {
+    DataType from = expr->getDataType();
+    if (from == type || from == DataType::Void) return expr;
+
+    switch (type) {
+        case DataType::Void:
+        case DataType::Array:
+        case DataType::Object:
+        case DataType::Struct: return expr;
+
+        default: {}
+    }
+
+    if (!IsIntegral(from) || !IsIntegral(type)) {
+        error("Cannot use " + printDataType(from) + " as " + printDataType(type) + ".");
+        return expr;
+    }
+
+    // The parser shares literal nodes, so make new ones
+    int64_t value = 0;
+    if (GetLiteral(expr, value)) {
+        if (IsLong(type)) {
+            AstQWord *i64 = new AstQWord((uint64_t)value);
+            i64->setDataType(type);
+            return i64;
+        }
+        if (IsLong(from) || type == DataType::UInt32) {
+            AstInt *i32 = new AstInt((uint64_t)(int64_t)(int32_t)value);
+            i32->setDataType(type);
+            return i32;
+        }
+        return expr;
+    }
+
+    // Bools are stored as ints already
+    if (type == DataType::Bool) return expr;
+
+    // Same width, different sign
+    if (IsLong(type) && IsLong(from)) return expr;
+    if (!IsLong(type) && !IsLong(from) && Promote(type) != DataType::Int32 && Promote(from) != DataType::Int32) return expr;
+
+    // Widening to a type that holds every value needs nothing
+    int64_t toMin = 0, toMax = 0, fromMin = 0, fromMax = 0;
+    if (!IsLong(type) && !IsLong(from)) {
+        if (!GetRange(type, toMin, toMax)) return expr;
+        if (GetRange(from, fromMin, fromMax) && fromMin >= toMin && fromMax <= toMax) return expr;
+    }
+
+    AstConvertOp *op = new AstConvertOp(expr, type);
+    return op;
+}
+
+// Declares a variable in the innermost scope
+void TypeChecker::declare(std::string name, DataType type, DataType subType, std::string className) {
+    Symbol symbol;
+    symbol.type = type;
+    symbol.subType = subType;
+    symbol.className = className;
+    scopes.back()[name] = symbol;
+}
+
+// Finds a variable, innermost scope first
+// Constant arrays are in scope everywhere, behind any local of the same name.
+bool TypeChecker::lookup(std::string name, Symbol &symbol) {
+    for (int i = scopes.size() - 1; i >= 0; i--) {
+        if (scopes[i].find(name) != scopes[i].end()) {
+            symbol = scopes[i][name];
+            return true;
+        }
+    }
+
+    if (globals.find(name) != globals.end()) {
+        symbol = globals[name];
+        return true;
+    }
+    return false;
+}
+
+// Finds a field of a structure variable (or an array of them)
+bool TypeChecker::lookupField(std::string name, std::string member, Var &field) {
+    Symbol var;
+    if (!lookup(name, var) || structs.find(var.className) == structs.end()) return false;
+    return structs[var.className]->getField(member, field);
+}
+
+void TypeChecker::error(std::string message) {
+    errors->addTypeError(line, message);
+}
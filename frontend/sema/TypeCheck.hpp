@@ -0,0 +1,59 @@
+//
+// Copyright 2021 Patrick Flynn
+// This file is part of the Espresso compiler.
+// Espresso is licensed under the BSD-3 license. See the COPYING file for more information.
+//
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <ast.hpp>
+#include <error/Manager.hpp>
+
+// A variable the type checker knows about
+struct Symbol {
+    DataType type = DataType::Void;
+    DataType subType = DataType::Void;
+    std::string className = "";
+    bool isConst = false;
+};
+
+// The type checking pass
+// This runs once over the AST after parsing. Every expression gets its type
+// (and class name, for objects) stored on it, and wherever a value is used as a
+// different type an explicit conversion is put in. Code generation only reads
+// the annotations.
+class TypeChecker {
+public:
+    explicit TypeChecker(AstTree *tree, ErrorManager *errors);
+    bool check();
+protected:
+    void checkFunction(AstFunction *func);
+    void checkBlock(AstBlock *block);
+    void checkStatement(AstStatement *stmt);
+    void checkStructCopy(std::string name, Symbol var, AstExpression *expr);
+    void checkReceiver(std::string name, std::string method);
+    void checkCall(std::string name, std::vector<AstExpression *> &args);
+    AstExpression *checkExpr(AstExpression *expr);
+    AstExpression *checkCondition(AstExpression *expr);
+    AstExpression *checkBinary(AstBinaryOp *op);
+    AstExpression *convert(AstExpression *expr, DataType type);
+
+    void declare(std::string name, DataType type, DataType subType = DataType::Void, std::string className = "");
+    bool lookup(std::string name, Symbol &symbol);
+    bool lookupField(std::string name, std::string member, Var &field);
+    void error(std::string message);
+private:
+    AstTree *tree;
+    ErrorManager *errors;
+
+    std::map<std::string, AstFunction *> functions;
+    std::map<std::string, AstStruct *> structs;
+    std::map<std::string, Symbol> globals;
+    std::vector<std::map<std::string, Symbol>> scopes;
+    AstFunction *current = nullptr;
+    int loops = 0;
+    int line = 0;
+};
@@ -8,6 +8,7 @@
 #include <cstdio>
 
 #include <parser/Parser.hpp>
+#include <sema/TypeCheck.hpp>
 #include <ast.hpp>
 
 #include <Compiler.hpp>
@@ -23,6 +24,11 @@ int main(int argc, char **argv) {
     bool testLex = false;
     bool printAst = false;
     bool runJavaP = false;
+    bool printStats = false;
+    bool printInline = false;
+    bool printTailCalls = false;
+    bool printSplits = false;
+    CompilerOptions options;
     
     for (int i = 1; i<argc; i++) {
         std::string arg = argv[i];
@@ -33,6 +39,34 @@ int main(int argc, char **argv) {
             printAst = true;
         } else if (arg == "--javap") {
             runJavaP = true;
+        } else if (arg == "--no-peephole") {
+            options.peephole = false;
+        } else if (arg == "--no-fold") {
+            options.fold = false;
+        } else if (arg.rfind("--target=", 0) == 0) {
+            options.target = atoi(arg.substr(9).c_str());
+            if (options.target < 52) {
+                std::cerr << "Invalid target: " << arg.substr(9) << " (must be 52 or higher)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--buffered-stdout") {
+            options.bufferedStdout = true;
+        } else if (arg == "--no-inline") {
+            options.inlining = false;
+        } else if (arg.rfind("--inline-threshold=", 0) == 0) {
+            options.inlineThreshold = atoi(arg.substr(19).c_str());
+        } else if (arg == "--inline-report") {
+            printInline = true;
+        } else if (arg == "--tail-call-report") {
+            printTailCalls = true;
+        } else if (arg == "--no-split") {
+            options.splitting = false;
+        } else if (arg.rfind("--split-limit=", 0) == 0) {
+            options.hugeMethodLimit = atoi(arg.substr(14).c_str());
+        } else if (arg == "--split-report") {
+            printSplits = true;
+        } else if (arg == "--stats") {
+            printStats = true;
         } else if (arg[0] == '-') {
             std::cerr << "Invalid option: " << arg << std::endl;
             return 1;
@@ -58,6 +92,16 @@ int main(int argc, char **argv) {
     
     delete frontend;
     
+    ErrorManager *errors = new ErrorManager;
+    TypeChecker *checker = new TypeChecker(tree, errors);
+    if (!checker->check()) {
+        errors->printErrors();
+        return 1;
+    }
+    
+    delete checker;
+    delete errors;
+    
     if (printAst) {
         tree->print();
         return 0;
@@ -67,9 +111,14 @@ int main(int argc, char **argv) {
     std::string className = GetClassName(input);
     std::cout << "Output: " << className << ".class" << std::endl;
     
-    Compiler *compiler = new Compiler(className);
+    Compiler *compiler = new Compiler(className, options);
     compiler->Build(tree);
-    compiler->Write();
+    if (!compiler->Write()) return 1;
+    
+    if (printStats) compiler->PrintStats();
+    if (printInline) compiler->PrintInlineReport();
+    if (printTailCalls) compiler->PrintTailCallReport();
+    if (printSplits) compiler->PrintSplitReport();
     
     if (runJavaP) {
         className += ".class";
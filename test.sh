@@ -48,6 +48,7 @@ echo "Running all tests..."
 echo ""
 
 run_test 'test/basic/*.eo' 'sys' $flags
+run_test 'test/basic/*.eo' 'sys' --buffered-stdout
 
 echo ""
 echo "$test_count tests passed successfully."